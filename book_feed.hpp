@@ -0,0 +1,91 @@
+#pragma once
+/*
+ * BookFeed: one OrderBookCore fed through an SPSC ring of MsgRecords,
+ * with results written to an SPSC ring of BookEvents.  A native feed
+ * handler publishes into input() from its own thread; the consumer loop
+ * (pump(), or the thread started by start()) applies whole spans of
+ * records in place, and the reader drains events().
+ *
+ *   feed handler ──MsgRecord──▶ [in ring] ──pump──▶ book ──▶ [out ring] ──▶ reader
+ */
+#include "orderbook_core.hpp"
+#include "spsc_ring.hpp"
+
+class BookFeed {
+    OrderBookCore         book_;
+    SpscRing<MsgRecord>   in_;
+    SpscRing<BookEvent>   out_;
+    std::atomic<bool>     stop_{false};
+    std::atomic<uint64_t> applied_{0};
+    std::atomic<uint64_t> errors_{0};
+    std::thread           thread_;
+
+    /* consumer-side sink; pump() only applies as many records as the
+       event ring has room for (one event per record at most), so the
+       push cannot fail and the consumer never waits on the reader      */
+    struct RingSink {
+        SpscRing<BookEvent>& ring;
+        void push_back(const BookEvent& ev){ ring.try_push(ev); }
+    };
+
+public:
+    explicit BookFeed(size_t in_capacity = size_t(1)<<16,
+                      size_t out_capacity = size_t(1)<<16)
+        : in_(in_capacity), out_(out_capacity) {}
+    ~BookFeed(){ stop(); }
+    BookFeed(const BookFeed&) = delete;
+    BookFeed& operator=(const BookFeed&) = delete;
+
+    SpscRing<MsgRecord>& input()  { return in_; }
+    SpscRing<BookEvent>& events() { return out_; }
+
+    /* the book itself; only safe to read while no consumer thread runs */
+    const OrderBookCore& book() const { return book_; }
+
+    uint64_t applied() const { return applied_.load(std::memory_order_acquire); }
+    uint64_t errors()  const { return errors_.load(std::memory_order_relaxed); }
+
+    /* apply whatever is in the input ring (up to max records, and no
+       more than the event ring has room for); returns the number applied,
+       0 while the reader is behind.  Call from the single consumer thread. */
+    size_t pump(size_t max = SIZE_MAX){
+        RingSink sink{out_};
+        size_t done = 0;
+        const MsgRecord* span;
+        size_t n, room;
+        while(done < max && (n = in_.peek(span)) && (room = out_.room())){
+            n = std::min({n, max-done, room});
+            for(size_t i=0;i<n;++i){
+                try{
+                    book_.apply_one(span[i], sink);
+                }catch(const std::exception&){
+                    errors_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            in_.release(n);
+            done += n;
+        }
+        if(done) applied_.fetch_add(done, std::memory_order_release);
+        return done;
+    }
+
+    /* run pump() on a dedicated thread, optionally pinned to cpu */
+    void start(int cpu = -1){
+        if(thread_.joinable()) return;
+        stop_.store(false, std::memory_order_relaxed);
+        thread_ = std::thread([this]{
+            unsigned idle = 0;
+            while(!stop_.load(std::memory_order_relaxed)){
+                if(pump()) { idle = 0; continue; }
+                if(++idle < 1024) cpu_relax();
+                else std::this_thread::yield();
+            }
+        });
+        if(cpu >= 0) pin_thread(thread_, cpu);
+    }
+    void stop(){
+        stop_.store(true, std::memory_order_relaxed);
+        if(thread_.joinable()) thread_.join();
+    }
+    bool running() const { return thread_.joinable(); }
+};
@@ -0,0 +1,150 @@
+#pragma once
+/*
+ * BookManager: many instruments, one OrderBookCore each.  Messages carry
+ * a compact instrument id that indexes straight into a vector of books,
+ * and books come from a pool so closing and reopening series does not
+ * reallocate their price windows.
+ */
+#include <deque>
+#include "orderbook_core.hpp"
+
+/* ---------- routed records ---------- */
+/* MsgRecord with an instrument id in front; layout matches routed_msg_dtype */
+#pragma pack(push,1)
+struct RoutedMsg {
+    uint32_t instrument;
+    uint8_t  msg_type;
+    uint64_t oid;
+    uint64_t old_oid;
+    uint8_t  venue;
+    uint8_t  side;
+    int32_t  price_ticks;
+    uint32_t qty;
+};
+#pragma pack(pop)
+static_assert(sizeof(RoutedMsg) == 31, "RoutedMsg must stay packed");
+
+/* event tagged with the instrument that produced it */
+struct RoutedEvent {
+    uint32_t  instrument;
+    BookEvent ev;
+};
+
+/* ---------- BookManager ---------- */
+class BookManager {
+public:
+    static constexpr uint32_t MAX_INSTRUMENTS = 1u<<24;   /* guards bad ids */
+
+private:
+    std::vector<OrderBookCore*> books_;          /* instrument → book / null */
+    std::deque<OrderBookCore>   storage_;        /* stable pool storage      */
+    std::vector<OrderBookCore*> free_;           /* reset books ready for reuse */
+    size_t                      open_{0};
+
+    /* forwards one book's events with its instrument attached */
+    template<class Sink>
+    struct Tagger {
+        Sink&    out;
+        uint32_t instrument;
+        void push_back(const BookEvent& ev){ out.push_back(RoutedEvent{instrument,ev}); }
+    };
+
+public:
+    BookManager() = default;
+    BookManager(const BookManager&) = delete;
+    BookManager& operator=(const BookManager&) = delete;
+
+    /* pre-create n pooled books so the first messages do not allocate */
+    void reserve(size_t n){
+        while(free_.size() < n){
+            storage_.emplace_back();
+            free_.push_back(&storage_.back());
+        }
+    }
+
+    /* book for instrument, taken from the pool on first use */
+    OrderBookCore& open(uint32_t instrument){
+        if(instrument < books_.size() && books_[instrument])
+            return *books_[instrument];
+        if(instrument >= MAX_INSTRUMENTS)
+            throw std::out_of_range("instrument id out of range");
+        if(instrument >= books_.size()) books_.resize(size_t(instrument)+1, nullptr);
+        if(free_.empty()) reserve(1);
+        OrderBookCore* b = free_.back();
+        free_.pop_back();
+        ++open_;
+        return *(books_[instrument] = b);
+    }
+
+    /* return an instrument's book to the pool (its orders are dropped) */
+    void close(uint32_t instrument){
+        OrderBookCore* b = find(instrument);
+        if(!b) return;
+        b->reset();
+        free_.push_back(b);
+        books_[instrument] = nullptr;
+        --open_;
+    }
+
+    OrderBookCore* find(uint32_t instrument){
+        return instrument < books_.size() ? books_[instrument] : nullptr;
+    }
+    const OrderBookCore* find(uint32_t instrument) const {
+        return instrument < books_.size() ? books_[instrument] : nullptr;
+    }
+
+    /* f(instrument, book) for every open instrument, in id order */
+    template<class F>
+    void for_each(F&& f) const {
+        for(size_t i=0;i<books_.size();++i)
+            if(books_[i]) f(uint32_t(i), *books_[i]);
+    }
+
+    size_t size()      const { return open_; }
+    size_t pooled()    const { return free_.size(); }
+    size_t allocated() const { return storage_.size(); }
+
+    /* mixed-instrument batch; Sink needs push_back(RoutedEvent) */
+    template<class Sink>
+    void apply(const RoutedMsg* msgs,size_t n,Sink& out){
+        for(size_t i=0;i<n;++i){
+            const RoutedMsg& r = msgs[i];
+            Tagger<Sink> tag{out, r.instrument};
+            open(r.instrument).apply_one(r, tag);
+        }
+    }
+};
+
+/* ---------- TickTable ---------- */
+/* tick size per instrument id; ids never set use DEFAULT_TICK */
+class TickTable {
+    std::vector<TickScale> scales_;
+    TickScale              default_;
+public:
+    void set(uint32_t instrument,double tick){
+        if(instrument >= BookManager::MAX_INSTRUMENTS)
+            throw std::out_of_range("instrument id out of range");
+        if(instrument >= scales_.size()) scales_.resize(size_t(instrument)+1);
+        scales_[instrument] = TickScale(tick);
+    }
+    const TickScale& operator[](uint32_t instrument) const {
+        return instrument < scales_.size() ? scales_[instrument] : default_;
+    }
+};
+
+/* column sink plus an instrument column; double prices are converted
+   with each instrument's own tick from ticks                          */
+template<class Price>
+struct BasicRoutedColumnSink : BasicColumnSink<Price> {
+    uint32_t*        instrument;
+    const TickTable* ticks{nullptr};
+
+    void push_back(const RoutedEvent& e){
+        if constexpr (std::is_floating_point<Price>::value)
+            if(ticks) this->scale = (*ticks)[e.instrument];
+        instrument[this->n] = e.instrument;
+        BasicColumnSink<Price>::push_back(e.ev);
+    }
+};
+using RoutedColumnSink     = BasicRoutedColumnSink<double>;
+using RoutedTickColumnSink = BasicRoutedColumnSink<int32_t>;
@@ -0,0 +1,148 @@
+#pragma once
+/*
+ * Optional instrumentation, compiled in with -DORDERBOOK_STATS.  Without
+ * it OB_STAT() and OB_TIME() expand to nothing and the book is exactly
+ * as before.
+ *
+ * Latencies are raw cycle counts (rdtsc / cntvct) recorded into
+ * LogHistograms: HDR-style buckets of SUB_BITS mantissa bits per power of
+ * two, so relative error stays below 1/2^SUB_BITS at any magnitude and a
+ * record is a clz and an increment.
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef ORDERBOOK_STATS
+#define OB_STAT(...) do { __VA_ARGS__; } while(0)
+#define OB_TIME(hist) CycleTimer ob_timer_(hist)
+constexpr bool STATS_ENABLED = true;
+#else
+#define OB_STAT(...) do {} while(0)
+#define OB_TIME(hist) do {} while(0)
+constexpr bool STATS_ENABLED = false;
+#endif
+
+inline uint64_t cycles(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+/* cycles() ticks per nanosecond, measured once over ~5 ms */
+inline double cycles_per_ns(){
+    static const double rate = []{
+        using clk = std::chrono::steady_clock;
+        auto     t0 = clk::now();
+        uint64_t c0 = cycles();
+        while(clk::now() - t0 < std::chrono::milliseconds(5)) {}
+        uint64_t c1 = cycles();
+        double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now()-t0).count());
+        return ns > 0 ? double(c1-c0)/ns : 1.0;
+    }();
+    return rate;
+}
+
+/* ---------- LogHistogram ---------- */
+class LogHistogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr int SUBS     = 1<<SUB_BITS;
+    static constexpr int BUCKETS  = (64-SUB_BITS+1)*SUBS;
+
+private:
+    std::array<uint64_t,BUCKETS> counts_{};
+    uint64_t n_{0}, sum_{0}, min_{UINT64_MAX}, max_{0};
+
+    static int bucket(uint64_t v){
+        if(v < SUBS) return int(v);                       /* exact below SUBS */
+        int e = 63-__builtin_clzll(v);                    /* v in [2^e, 2^e+1) */
+        int sub = int(v >> (e-SUB_BITS)) & (SUBS-1);
+        return (e-SUB_BITS+1)*SUBS + sub;
+    }
+    /* largest value that lands in bucket b */
+    static uint64_t upper(int b){
+        if(b < SUBS) return uint64_t(b);
+        int e = b/SUBS + SUB_BITS-1, sub = b%SUBS;
+        uint64_t lo = (uint64_t(SUBS+sub)) << (e-SUB_BITS);
+        return lo + (uint64_t(1) << (e-SUB_BITS)) - 1;
+    }
+
+public:
+    void record(uint64_t v){
+        ++counts_[bucket(v)];
+        ++n_; sum_ += v;
+        if(v < min_) min_ = v;
+        if(v > max_) max_ = v;
+    }
+    void reset(){ *this = LogHistogram{}; }
+
+    uint64_t count() const { return n_; }
+    uint64_t min()   const { return n_ ? min_ : 0; }
+    uint64_t max()   const { return max_; }
+    double   mean()  const { return n_ ? double(sum_)/n_ : 0; }
+
+    /* value at quantile q in [0,1], to bucket resolution */
+    uint64_t quantile(double q) const {
+        if(!n_) return 0;
+        uint64_t rank = uint64_t(q*double(n_-1)) + 1, seen = 0;
+        for(int b=0;b<BUCKETS;++b)
+            if((seen += counts_[b]) >= rank) return std::min(upper(b), max_);
+        return max_;
+    }
+
+    void merge(const LogHistogram& o){
+        for(int b=0;b<BUCKETS;++b) counts_[b] += o.counts_[b];
+        n_ += o.n_; sum_ += o.sum_;
+        if(o.min_ < min_) min_ = o.min_;
+        if(o.max_ > max_) max_ = o.max_;
+    }
+};
+
+/* records cycles from construction to destruction */
+class CycleTimer {
+    LogHistogram& h_;
+    uint64_t      t0_;
+public:
+    explicit CycleTimer(LogHistogram& h) : h_(h), t0_(cycles()) {}
+    ~CycleTimer(){ h_.record(cycles()-t0_); }
+    CycleTimer(const CycleTimer&) = delete;
+    CycleTimer& operator=(const CycleTimer&) = delete;
+};
+
+/* ---------- counters ---------- */
+struct LevelCounters {
+    uint64_t creates{0};        /* level went from empty to live    */
+    uint64_t deletes{0};        /* level emptied                    */
+    uint64_t rescans{0};        /* best emptied, cursor re-searched */
+    uint64_t sparse_hits{0};    /* add / remove outside the window  */
+    uint64_t recentres{0};      /* empty window moved to the best   */
+    void merge(const LevelCounters& o){
+        creates+=o.creates; deletes+=o.deletes; rescans+=o.rescans;
+        sparse_hits+=o.sparse_hits; recentres+=o.recentres;
+    }
+};
+struct MapCounters {
+    uint64_t lookups{0};        /* find / insert / erase calls      */
+    uint64_t probes{0};         /* slots inspected by them          */
+};
+
+enum StatOp : uint8_t { OP_ADD, OP_CANCEL, OP_REPLACE, OP_EXECUTE, NUM_OPS };
+
+/* everything OrderBookCore::stats() reports */
+struct BookStats {
+    std::array<LogHistogram,NUM_OPS> latency;      /* cycles per message */
+    LevelCounters levels;
+    MapCounters   int_orders;
+    MapCounters   string_orders;
+};
@@ -0,0 +1,53 @@
+#pragma once
+/*
+ * Registrable event sinks.  apply(), apply_conflated() and wire::decode()
+ * take any Sink with push_back(const BookEvent&) as a template parameter,
+ * which is what native code wired up at compile time should use.
+ * EventSink is the run-time counterpart, for a consumer chosen when the
+ * process starts (a publisher picked by configuration, the Python
+ * callback): BatchingSink buffers events and hands them over N at a
+ * time, so the virtual call -- and for Python the GIL round trip -- is
+ * paid once per batch rather than once per event.
+ *
+ * Events carry their kind in BookEvent::type (EV_NBBO / EV_EXEC); no
+ * consumer has to tell them apart by shape.
+ */
+#include <vector>
+#include "orderbook_core.hpp"
+
+/* ---------- EventSink ---------- */
+struct EventSink {
+    virtual ~EventSink() = default;
+    /* n >= 1 events in book order; ev is only valid during the call */
+    virtual void on_events(const BookEvent* ev,size_t n) = 0;
+};
+
+/* ---------- BatchingSink  (push_back adapter over an EventSink) ---------- */
+class BatchingSink {
+    EventSink*             sink_;
+    size_t                 batch_;
+    std::vector<BookEvent> buf_;
+    uint64_t               pushed_{0};
+public:
+    explicit BatchingSink(EventSink& sink,size_t batch = 256)
+        : sink_(&sink), batch_(std::max<size_t>(batch, 1)) { buf_.reserve(batch_); }
+
+    void push_back(const BookEvent& ev){
+        buf_.push_back(ev);
+        ++pushed_;
+        if(buf_.size() >= batch_) flush();
+    }
+    /* hand over whatever is pending (end of a feed chunk, shutdown) */
+    void flush(){
+        if(buf_.empty()) return;
+        try{ sink_->on_events(buf_.data(), buf_.size()); }
+        catch(...){ buf_.clear(); throw; }              /* never redeliver */
+        buf_.clear();
+    }
+    /* drop pending events without delivering them */
+    void discard(){ buf_.clear(); }
+
+    size_t   pending() const { return buf_.size(); }
+    uint64_t pushed()  const { return pushed_; }     /* events ever accepted */
+    size_t   batch()   const { return batch_; }
+};
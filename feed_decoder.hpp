@@ -0,0 +1,136 @@
+#pragma once
+/*
+ * Compact binary market-data format and its decoder.
+ *
+ * A stream is a sequence of messages with no padding.  Each message is
+ * a one-byte MsgType followed by a fixed-size little-endian body:
+ *
+ *   'A' add      oid u64, venue u8, side u8, price_ticks i32, qty u32   (19 B)
+ *   'X' cancel   oid u64                                               ( 9 B)
+ *   'R' replace  oid u64, old_oid u64, venue u8, side u8,
+ *                price_ticks i32, qty u32                              (27 B)
+ *   'E' execute  oid u64, exec_qty u32                                 (13 B)
+ *
+ * venue is an index into VENUES and side a Side value, as in MsgRecord.
+ * decode() turns a buffer straight into book updates; its only branch
+ * per message is the type dispatch.
+ */
+#include <cstring>
+#include "orderbook_core.hpp"
+
+namespace wire {
+
+/* message size by type byte, 0 for unknown types */
+struct SizeTable {
+    uint8_t len[256]{};
+    constexpr SizeTable(){
+        len[MSG_ADD]     = 19;
+        len[MSG_CANCEL]  = 9;
+        len[MSG_REPLACE] = 27;
+        len[MSG_EXECUTE] = 13;
+    }
+};
+inline constexpr SizeTable SIZES{};
+constexpr size_t MAX_MSG = 27;
+
+template<class T>
+inline T load(const uint8_t* p){
+    T v;
+    std::memcpy(&v, p, sizeof v);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if constexpr (sizeof(T) == 8) v = T(__builtin_bswap64(uint64_t(v)));
+    if constexpr (sizeof(T) == 4) v = T(__builtin_bswap32(uint32_t(v)));
+#endif
+    return v;
+}
+template<class T>
+inline void store(uint8_t* p,T v){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if constexpr (sizeof(T) == 8) v = T(__builtin_bswap64(uint64_t(v)));
+    if constexpr (sizeof(T) == 4) v = T(__builtin_bswap32(uint32_t(v)));
+#endif
+    std::memcpy(p, &v, sizeof v);
+}
+
+/* parse one complete message at p (type byte already validated) */
+inline MsgRecord parse(const uint8_t* p){
+    MsgRecord r{};
+    r.msg_type = p[0];
+    switch(p[0]){
+    case MSG_ADD:
+        r.oid         = load<uint64_t>(p+1);
+        r.venue       = p[9];
+        r.side        = p[10];
+        r.price_ticks = load<int32_t>(p+11);
+        r.qty         = load<uint32_t>(p+15);
+        break;
+    case MSG_CANCEL:
+        r.oid         = load<uint64_t>(p+1);
+        break;
+    case MSG_REPLACE:
+        r.oid         = load<uint64_t>(p+1);
+        r.old_oid     = load<uint64_t>(p+9);
+        r.venue       = p[17];
+        r.side        = p[18];
+        r.price_ticks = load<int32_t>(p+19);
+        r.qty         = load<uint32_t>(p+23);
+        break;
+    case MSG_EXECUTE:
+        r.oid         = load<uint64_t>(p+1);
+        r.qty         = load<uint32_t>(p+9);
+        break;
+    }
+    return r;
+}
+
+/* write r in wire format; returns bytes written (out needs MAX_MSG) */
+inline size_t encode(const MsgRecord& r,uint8_t* out){
+    out[0] = r.msg_type;
+    switch(r.msg_type){
+    case MSG_ADD:
+        store(out+1, r.oid);
+        out[9]  = r.venue;
+        out[10] = r.side;
+        store(out+11, r.price_ticks);
+        store(out+15, r.qty);
+        return 19;
+    case MSG_CANCEL:
+        store(out+1, r.oid);
+        return 9;
+    case MSG_REPLACE:
+        store(out+1, r.oid);
+        store(out+9, r.old_oid);
+        out[17] = r.venue;
+        out[18] = r.side;
+        store(out+19, r.price_ticks);
+        store(out+23, r.qty);
+        return 27;
+    case MSG_EXECUTE:
+        store(out+1, r.oid);
+        store(out+9, r.qty);
+        return 13;
+    }
+    throw std::runtime_error("Bad msg_type");
+}
+
+struct DecodeResult {
+    size_t bytes;       /* consumed; a trailing partial message is left */
+    size_t messages;
+};
+
+/* decode every complete message in buf into book; Sink as for apply() */
+template<class Book,class Sink>
+DecodeResult decode(const uint8_t* buf,size_t len,Book& book,Sink& out){
+    size_t off = 0, msgs = 0;
+    while(off < len){
+        size_t n = SIZES.len[buf[off]];
+        if(!n) throw std::runtime_error("unknown message type at offset " + std::to_string(off));
+        if(off + n > len) break;
+        book.apply_one(parse(buf+off), out);
+        off += n;
+        ++msgs;
+    }
+    return {off, msgs};
+}
+
+} // namespace wire
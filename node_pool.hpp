@@ -0,0 +1,113 @@
+#pragma once
+/*
+ * Fixed-size free-list pool for container nodes.  Blocks are carved from
+ * slabs that are never returned until the pool dies, so once a book has
+ * seen its peak number of sparse levels / string orders, add and cancel
+ * recycle nodes without touching malloc.
+ *
+ * PoolAllocator<T> routes single-node allocations of the pool's block
+ * size to the pool and everything else (bucket arrays, other sizes) to
+ * the global heap; the block size is claimed by the first single-node
+ * allocation, which for std::map / std::unordered_map is a node.  Blocks
+ * honour the node's alignment, so over-aligned values (PriceLevel) work.
+ */
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+struct PoolStats {
+    size_t block_size{0};
+    size_t live{0};             /* blocks in use                  */
+    size_t high_water{0};       /* peak blocks in use             */
+    size_t capacity{0};         /* blocks carved so far           */
+    size_t slabs{0};
+};
+
+class NodePool {
+    struct FreeBlock { FreeBlock* next; };
+
+    size_t blocks_per_slab_;
+    size_t block_{0};                   /* rounded block size        */
+    size_t claimed_{0};                 /* sizeof(T) that owns it    */
+    size_t align_{alignof(std::max_align_t)};
+    FreeBlock* free_{nullptr};
+    struct SlabFree {
+        size_t align;
+        void operator()(unsigned char* p) const { ::operator delete(p, std::align_val_t(align)); }
+    };
+    std::vector<std::unique_ptr<unsigned char[],SlabFree>> slabs_;
+    PoolStats st_;
+
+    void grow(){
+        size_t n = blocks_per_slab_ << std::min<size_t>(slabs_.size(), 6);
+        auto* raw = static_cast<unsigned char*>(::operator new(n*block_, std::align_val_t(align_)));
+        slabs_.emplace_back(raw, SlabFree{align_});
+        unsigned char* p = raw;
+        for(size_t i=n; i-->0;){
+            auto* b = reinterpret_cast<FreeBlock*>(p + i*block_);
+            b->next = free_;
+            free_   = b;
+        }
+        st_.capacity += n;
+        st_.slabs     = slabs_.size();
+    }
+
+public:
+    explicit NodePool(size_t blocks_per_slab = 256) : blocks_per_slab_(blocks_per_slab) {}
+    NodePool(const NodePool&) = delete;                 /* containers point here */
+    NodePool& operator=(const NodePool&) = delete;
+
+    /* true if a size-byte, align-aligned block belongs to this pool */
+    bool owns(size_t size,size_t align){
+        if(!block_){
+            size_t a = align_ = std::max(align, alignof(std::max_align_t));
+            block_ = (std::max(size, sizeof(FreeBlock)) + a-1) & ~(a-1);
+            st_.block_size = block_;
+            claimed_ = size;
+        }
+        return size == claimed_ && align <= align_;
+    }
+    void* alloc(){
+        if(!free_) grow();
+        FreeBlock* b = free_;
+        free_ = b->next;
+        if(++st_.live > st_.high_water) st_.high_water = st_.live;
+        return b;
+    }
+    void free(void* p){
+        auto* b = static_cast<FreeBlock*>(p);
+        b->next = free_;
+        free_   = b;
+        --st_.live;
+    }
+
+    /* carve blocks up front (only once the block size is known) */
+    void reserve(size_t blocks){ while(block_ && st_.capacity < blocks) grow(); }
+
+    const PoolStats& stats() const { return st_; }
+};
+
+template<class T>
+struct PoolAllocator {
+    using value_type = T;
+    NodePool* pool;
+
+    explicit PoolAllocator(NodePool* p) noexcept : pool(p) {}
+    template<class U>
+    PoolAllocator(const PoolAllocator<U>& o) noexcept : pool(o.pool) {}
+
+    T* allocate(size_t n){
+        if(n==1 && pool->owns(sizeof(T), alignof(T)))
+            return static_cast<T*>(pool->alloc());
+        return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(alignof(T))));
+    }
+    void deallocate(T* p,size_t n) noexcept {
+        if(n==1 && pool->owns(sizeof(T), alignof(T))) pool->free(p);
+        else ::operator delete(p, std::align_val_t(alignof(T)));
+    }
+
+    template<class U> bool operator==(const PoolAllocator<U>& o) const { return pool==o.pool; }
+    template<class U> bool operator!=(const PoolAllocator<U>& o) const { return pool!=o.pool; }
+};
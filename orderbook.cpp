@@ -1,257 +1,1202 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
-#include <array>
-#include <vector>
-#include <set>
-#include <unordered_map>
-#include <string_view>
-#include <limits>
+#include <pybind11/numpy.h>
+#include "orderbook_core.hpp"
+#include "book_manager.hpp"
+#include "sharded_manager.hpp"
+#include "book_feed.hpp"
+#include "feed_decoder.hpp"
+#include "replay.hpp"
+#include "snapshot.hpp"
+#include "event_sink.hpp"
+#include "shm_nbbo.hpp"
 
 namespace py = pybind11;
 
-/* ---------- constants / helpers ---------- */
-constexpr double TICK = 0.01;
-constexpr int    INV_TICK = 100;
-constexpr size_t NUM_VENUES = 14;
+/* ---------- conversions shared by the adapters ---------- */
+/* alphabetical venue letters for a mask, from the lookup table */
+static py::str venue_str(uint16_t mask) {
+    std::string_view v = venue_string(mask);
+    return py::str(v.data(), v.size());
+}
 
-static const std::array<std::string_view,NUM_VENUES> VENUES = {
-    "CBOE","ISE","BOX","MIAX","ARCA","PHLX","GEM","EDGX",
-    "BAT","MRX","BZX","NDQ","C2","AMEX"
-};
-static const std::unordered_map<std::string_view,size_t> VENUE_MAP = {
-    {"CBOE",0},{"ISE",1},{"BOX",2},{"MIAX",3},{"ARCA",4},
-    {"PHLX",5},{"GEM",6},{"EDGX",7},{"BAT",8},{"MRX",9},
-    {"BZX",10},{"NDQ",11},{"C2",12},{"AMEX",13}
-};
+/* price in the caller's units: float via scale, or int ticks if null;
+   NO_TICK (no price) is None                                          */
+static py::object price_obj(int ticks, const TickScale* scale) {
+    if (ticks == NO_TICK) return py::none();
+    return scale ? py::object(py::float_(scale->to_price(ticks)))
+                 : py::object(py::int_(ticks));
+}
 
-inline int    p2i(double p){ return int(p*INV_TICK + 0.5); }
-inline double i2p(int idx){  return idx*TICK; }
+/* build the Python payload for a C++ event */
+static py::object event_tuple(const BookEvent& ev, const TickScale* scale) {
+    if (ev.type == EV_NBBO)
+        /* new_px, new_sz, old_px, old_sz, old_venues  (len == 5) */
+        return py::make_tuple(
+            price_obj(ev.idx, scale), ev.agg,
+            price_obj(ev.old_idx, scale), ev.old_agg,
+            venue_str(ev.vmask)          // e.g. "CNX"
+        );
+    py::list per_venue;
+    for (size_t i = 0; i < NUM_VENUES; ++i) per_venue.append(ev.vqty[i]);
+    /* exec_price, total_remaining, qty_list, venue_str  (len == 4) */
+    return py::make_tuple(price_obj(ev.idx, scale), ev.agg, per_venue,
+                          venue_str(ev.vmask));
+}
+/* b"BID" → Bid, anything else → Ask; reads the bytes in place */
+static Side side_of(const py::bytes& side_b){
+    char* p; Py_ssize_t n;
+    if (PyBytes_AsStringAndSize(side_b.ptr(), &p, &n) != 0) throw py::error_already_set();
+    return n == 3 && p[0] == 'B' && p[1] == 'I' && p[2] == 'D' ? Side::Bid : Side::Ask;
+}
+static py::dict pool_dict(const PoolStats& st) {
+    py::dict d;
+    d["block_size"] = st.block_size;
+    d["live"]       = st.live;
+    d["high_water"] = st.high_water;
+    d["capacity"]   = st.capacity;
+    d["slabs"]      = st.slabs;
+    return d;
+}
+/* latency histogram summary, converted from cycles to ns */
+static py::dict hist_dict(const LogHistogram& h, double cyc_per_ns) {
+    auto ns = [cyc_per_ns](uint64_t c){ return double(c) / cyc_per_ns; };
+    py::dict d;
+    d["count"]   = h.count();
+    d["min_ns"]  = ns(h.min());
+    d["mean_ns"] = h.mean() / cyc_per_ns;
+    d["p50_ns"]  = ns(h.quantile(0.50));
+    d["p90_ns"]  = ns(h.quantile(0.90));
+    d["p99_ns"]  = ns(h.quantile(0.99));
+    d["p999_ns"] = ns(h.quantile(0.999));
+    d["max_ns"]  = ns(h.max());
+    return d;
+}
+static py::object best_or_none(const OrderBookCore& b, Side s, const TickScale* scale){
+    return b.empty(s) ? py::object(py::none()) : price_obj(b.best_idx(s), scale);
+}
 
-/* ---------- PriceLevel ---------- */
-struct PriceLevel {
-    std::array<uint32_t,NUM_VENUES> vqty{};
-    uint32_t agg{0};
-    void adjust(size_t vid,int d){ vqty[vid]+=d; agg+=d; }
+/* records: 1-D structured array of Rec's dtype, or any contiguous buffer
+   of packed Recs.  The view holds the buffer export: keep it alive for as
+   long as recs is used (GIL-released loops included), so the exporter
+   can neither resize nor unmap the memory underneath.                  */
+template<class Rec>
+struct RecordView {
+    py::buffer_info info;
+    const Rec*      recs;
+    size_t          n;
 };
+template<class Rec>
+static RecordView<Rec> record_view(const py::buffer& records) {
+    py::buffer_info info = records.request();
+    auto* recs = static_cast<const Rec*>(info.ptr);
+    size_t n;
+    if (info.ndim == 1 && info.itemsize == ssize_t(sizeof(Rec))
+                       && info.strides[0] == info.itemsize)
+        n = size_t(info.shape[0]);
+    else if (info.itemsize == 1 && info.size % ssize_t(sizeof(Rec)) == 0)
+        n = size_t(info.size) / sizeof(Rec);
+    else
+        throw py::value_error("expected a contiguous buffer of packed records");
+    return {std::move(info), recs, n};
+}
+
+/* queued records → structured array; empties the queue */
+template<class Rec>
+static py::array_t<Rec> drain(std::vector<Rec>& q) {
+    py::array_t<Rec> out(q.size());
+    std::copy(q.begin(), q.end(), out.mutable_data());
+    q.clear();
+    return out;
+}
+
+template<class T>
+using column = py::array_t<T, py::array::c_style>;
+
+/* output columns for on_batch_array_into; rows must cover n events.
+   float64 price columns get prices, int32 ones get ticks.            */
+template<class P>
+static BasicColumnSink<P> column_sink(size_t n,
+                                      column<uint8_t>&  event_type,
+                                      column<P>&        price,
+                                      column<uint32_t>& agg,
+                                      column<P>&        old_price,
+                                      column<uint32_t>& old_agg,
+                                      column<uint16_t>& venue_mask,
+                                      column<uint32_t>& venue_qty) {
+    auto fits = [n](const py::array& a){ return a.ndim() >= 1 && size_t(a.shape(0)) >= n; };
+    if (!fits(event_type) || !fits(price) || !fits(agg) || !fits(old_price) ||
+        !fits(old_agg) || !fits(venue_mask) || !fits(venue_qty))
+        throw py::value_error("output columns shorter than the batch");
+    if (venue_qty.ndim() != 2 || size_t(venue_qty.shape(1)) != NUM_VENUES)
+        throw py::value_error("venue_qty must have shape (rows, 14)");
+    return BasicColumnSink<P>{event_type.mutable_data(), price.mutable_data(),
+                      agg.mutable_data(), old_price.mutable_data(),
+                      old_agg.mutable_data(), venue_mask.mutable_data(),
+                      venue_qty.mutable_data()};
+}
 
-/* ---------- SideBook  (only sparse set) ---------- */
-class SideBook {
-    bool is_bid_;
-    std::set<int> ticks_;                       /* sorted price indices   */
-    std::unordered_map<int,PriceLevel> levels_; /* idx → bucket           */
+/* queue a snapshot of src on w (started by start_snapshots) */
+template<class Source>
+static void offer_to(const std::unique_ptr<SnapshotWriter>& w, const Source& src, uint64_t seq) {
+    if (!w) throw std::runtime_error("start_snapshots() first");
+    py::gil_scoped_release nogil;
+    w->offer(src, seq);
+}
+/* wait for queued snapshots; returns how many have been written */
+static uint64_t flush_writer(const std::unique_ptr<SnapshotWriter>& w) {
+    if (!w) return 0;
+    {
+        py::gil_scoped_release nogil;
+        w->flush();
+    }
+    std::string err = w->error();
+    if (!err.empty()) throw std::runtime_error(err);
+    return w->written();
+}
 
+/* EventSink calling a Python callable with one event_dtype array per
+   batch; the GIL is taken for the call only                          */
+class PyCallbackSink : public EventSink {
+    py::object fn_;
 public:
-    explicit SideBook(bool is_bid): is_bid_(is_bid){}
-    ~SideBook() = default;
-
-    /* add qty, return prev_best if best moved else INT_MIN */
-    int add(int idx,size_t vid,uint32_t qty){
-        auto &pl = levels_[idx];
-        int prev_best = best_idx();
-        bool first    = pl.agg==0;
-        pl.adjust(vid, int(qty));
-        if(first) ticks_.insert(idx);
-        int new_best  = best_idx();
-        if (prev == (is_bid_ ? -1 : std::numeric_limits<int>::max())){
-            return std::numeric_limits<int>::min();  // ignore sentinel-to-real 
+    explicit PyCallbackSink(py::object fn) : fn_(std::move(fn)) {}
+    void on_events(const BookEvent* ev, size_t n) override {
+        py::gil_scoped_acquire gil;
+        py::array_t<EventRecord> out(n);
+        EventRecord* r = out.mutable_data();
+        for (size_t i = 0; i < n; ++i) r[i] = to_record(ev[i]);
+        fn_(out);
+    }
+};
+
+/* ---------- OrderBook  (Python adapter over OrderBookCore) ---------- */
+class OrderBook {
+    OrderBookCore core_;
+    TickScale     scale_;
+    bool          int_prices_;                   /* outputs in ticks      */
+
+    std::vector<BookEvent> events_;              /* scratch for batches   */
+    std::vector<MsgRecord> records_;             /* scratch for on_batch_int */
+    std::unique_ptr<SnapshotWriter> snapshots_;  /* periodic snapshots    */
+    std::unique_ptr<PyCallbackSink> callback_;   /* submit_* event sink   */
+    std::unique_ptr<BatchingSink>   batcher_;
+
+    /* run a tuple batch with string oids (needs the GIL throughout) */
+    template<class Sink>
+    void run_batch(py::iterable batch, Sink& out) {
+        BookEvent ev;
+        for (auto item : batch) {
+            auto t   = item.cast<py::tuple>();
+            std::string cmd = t[0].cast<std::string>();
+
+            if (cmd == "add") {
+                if (core_.add(t[1].cast<std::string>(),                 // oid
+                              venue_of(t[2].cast<char>()),              // venue
+                              side_of(t[3].cast<py::bytes>()),          // side
+                              scale_.to_ticks(t[4].cast<double>()),     // price
+                              t[5].cast<uint32_t>(), ev))               // qty
+                    out.push_back(ev);
+
+            } else if (cmd == "execute") {
+                if (core_.execute(t[1].cast<std::string>(),             // oid
+                                  t[2].cast<uint32_t>(), ev))           // exec_qty
+                    out.push_back(ev);
+
+            } else if (cmd == "cancel") {
+                core_.cancel(t[1].cast<std::string>());   // nothing to append
+
+            } else if (cmd == "replace") {
+                if (core_.replace(t[1].cast<std::string>(),             // new_oid
+                                  t[2].cast<std::string>(),             // old_oid
+                                  venue_of(t[3].cast<char>()),          // venue
+                                  side_of(t[4].cast<py::bytes>()),      // side
+                                  scale_.to_ticks(t[5].cast<double>()), // price
+                                  t[6].cast<uint32_t>(), ev))           // qty
+                    out.push_back(ev);
+
+            } else {
+                throw std::runtime_error("Bad cmd");
+            }
         }
-        return (new_best != prev_best) ? prev_best
-                                       : std::numeric_limits<int>::min();
     }
 
-    /* remove qty, erase level if empty, update ticks_ */
-    void remove(int idx,size_t vid,uint32_t qty){
-        auto &pl = levels_.at(idx);
-        pl.adjust(vid,-int(qty));
-        if(pl.agg==0){
-            ticks_.erase(idx);
-            levels_.erase(idx);
+    const TickScale* out_scale() const { return int_prices_ ? nullptr : &scale_; }
+    py::object event_tuple(const BookEvent& ev) const { return ::event_tuple(ev, out_scale()); }
+    py::object event_or_none(bool has, const BookEvent& ev) const {
+        return has ? event_tuple(ev) : py::none();
+    }
+
+    /* integer-oid tuple → MsgRecord, so the batch can run without the GIL */
+    MsgRecord encode(const py::tuple& t) const {
+        std::string cmd = t[0].cast<std::string>();
+        MsgRecord r{};
+        if (cmd == "add") {
+            r.msg_type    = MSG_ADD;
+            r.oid         = t[1].cast<uint64_t>();
+            r.venue       = uint8_t(venue_of(t[2].cast<char>()));
+            r.side        = uint8_t(side_of(t[3].cast<py::bytes>()));
+            r.price_ticks = scale_.to_ticks(t[4].cast<double>());
+            r.qty         = t[5].cast<uint32_t>();
+        } else if (cmd == "execute") {
+            r.msg_type    = MSG_EXECUTE;
+            r.oid         = t[1].cast<uint64_t>();
+            r.qty         = t[2].cast<uint32_t>();
+        } else if (cmd == "cancel") {
+            r.msg_type    = MSG_CANCEL;
+            r.oid         = t[1].cast<uint64_t>();
+        } else if (cmd == "replace") {
+            r.msg_type    = MSG_REPLACE;
+            r.oid         = t[1].cast<uint64_t>();
+            r.old_oid     = t[2].cast<uint64_t>();
+            r.venue       = uint8_t(venue_of(t[3].cast<char>()));
+            r.side        = uint8_t(side_of(t[4].cast<py::bytes>()));
+            r.price_ticks = scale_.to_ticks(t[5].cast<double>());
+            r.qty         = t[6].cast<uint32_t>();
+        } else {
+            throw std::runtime_error("Bad cmd");
         }
+        return r;
     }
 
-    int  best_idx() const {
-        if(ticks_.empty())
-            return is_bid_ ? -1 : std::numeric_limits<int>::max();
-        return is_bid_ ? *ticks_.rbegin() : *ticks_.begin();
+    py::list events_list() const {
+        py::list out;
+        for (const auto& ev : events_) out.append(event_tuple(ev));
+        return out;
     }
-    double best_price() const {
-        int b = best_idx();
-        if(is_bid_ && b==-1) return NAN;
-        if(!is_bid_ && b==std::numeric_limits<int>::max()) return NAN;
-        return i2p(b);
+
+    BatchingSink& batcher() {
+        if (!batcher_) throw std::runtime_error("no event callback registered");
+        return *batcher_;
+    }
+    /* run fn(sink) with the GIL released, conflated or not, into the
+       batcher; returns the number of events it produced               */
+    template<class F>
+    size_t submit(F&& fn, bool conflate, bool flush) {
+        BatchingSink& b = batcher();
+        uint64_t before = b.pushed();
+        {
+            py::gil_scoped_release nogil;
+            if (conflate) {
+                ConflatingSink<BatchingSink> c(core_, b);
+                fn(c);
+                c.finish();
+            } else {
+                fn(b);
+            }
+        }
+        if (flush) b.flush();
+        return size_t(b.pushed() - before);
     }
 
-    /* expose levels for snapshot */
-    const std::unordered_map<int,PriceLevel>& levels() const { return levels_; }
+    py::list apply_to_list(const MsgRecord* recs, size_t n, bool conflate) {
+        events_.clear();
+        {
+            py::gil_scoped_release nogil;
+            if (conflate) core_.apply_conflated(recs, n, events_);
+            else          core_.apply(recs, n, events_);
+        }
+        return events_list();
+    }
 
-    py::dict snapshot(int idx) const {
+    public:
+    explicit OrderBook(double tick_size = DEFAULT_TICK, bool int_prices = false)
+        : scale_(tick_size), int_prices_(int_prices) {}
+
+    double tick_size() const { return scale_.tick; }
+
+    /* ---------- single-message API ---------- */
+    py::object on_add(const std::string& oid,const char venue_code,
+                      const py::bytes& side_b,double price,uint32_t qty){
+        BookEvent ev;
+        bool has = core_.add(oid,venue_of(venue_code),side_of(side_b),scale_.to_ticks(price),qty,ev);
+        return event_or_none(has,ev);
+    }
+
+    void on_cancel(const std::string& oid){ core_.cancel(oid); }
+
+    py::object on_replace(const std::string& new_oid,const std::string& old_oid,
+                          char venue_code,const py::bytes& side_b,
+                          double price,uint32_t qty){
+        BookEvent ev;
+        bool has = core_.replace(new_oid,old_oid,venue_of(venue_code),side_of(side_b),
+                                 scale_.to_ticks(price),qty,ev);
+        return event_or_none(has,ev);
+    }
+
+    py::object on_execute(const std::string& oid, uint32_t exec_qty) {
+        BookEvent ev;
+        return event_or_none(core_.execute(oid,exec_qty,ev),ev);
+    }
+
+    /* ---------- integer order-ID fast path ---------- */
+    py::object on_add(uint64_t oid,const char venue_code,
+                      const py::bytes& side_b,double price,uint32_t qty){
+        BookEvent ev;
+        bool has = core_.add(oid,venue_of(venue_code),side_of(side_b),scale_.to_ticks(price),qty,ev);
+        return event_or_none(has,ev);
+    }
+
+    void on_cancel(uint64_t oid){ core_.cancel(oid); }
+
+    py::object on_replace(uint64_t new_oid,uint64_t old_oid,
+                          char venue_code,const py::bytes& side_b,
+                          double price,uint32_t qty){
+        BookEvent ev;
+        bool has = core_.replace(new_oid,old_oid,venue_of(venue_code),side_of(side_b),
+                                 scale_.to_ticks(price),qty,ev);
+        return event_or_none(has,ev);
+    }
+
+    py::object on_execute(uint64_t oid, uint32_t exec_qty) {
+        BookEvent ev;
+        return event_or_none(core_.execute(oid,exec_qty,ev),ev);
+    }
+
+    /* ---------- bulk session operations ---------- */
+    /* drop every order at a venue / on a side / in the book in one call;
+       returns the NBBO events, at most one per side (bid first)       */
+    py::list cancel_venue(char venue_code) {
+        events_.clear();
+        core_.cancel_venue(venue_of(venue_code), events_);
+        return events_list();
+    }
+    py::list clear_side(const py::bytes& side_b) {
+        events_.clear();
+        core_.clear_side(side_of(side_b), events_);
+        return events_list();
+    }
+    py::list cancel_all() {
+        events_.clear();
+        core_.cancel_all(events_);
+        return events_list();
+    }
+
+    /* ---------- tick-native API (price already in ticks) ---------- */
+    py::object on_add_ticks(uint64_t oid,char venue_code,const py::bytes& side_b,
+                            int32_t price_ticks,uint32_t qty){
+        BookEvent ev;
+        bool has = core_.add(oid,venue_of(venue_code),side_of(side_b),price_ticks,qty,ev);
+        return event_or_none(has,ev);
+    }
+    py::object on_add_ticks(const std::string& oid,char venue_code,const py::bytes& side_b,
+                            int32_t price_ticks,uint32_t qty){
+        BookEvent ev;
+        bool has = core_.add(oid,venue_of(venue_code),side_of(side_b),price_ticks,qty,ev);
+        return event_or_none(has,ev);
+    }
+    py::object on_replace_ticks(uint64_t new_oid,uint64_t old_oid,char venue_code,
+                                const py::bytes& side_b,int32_t price_ticks,uint32_t qty){
+        BookEvent ev;
+        bool has = core_.replace(new_oid,old_oid,venue_of(venue_code),side_of(side_b),
+                                 price_ticks,qty,ev);
+        return event_or_none(has,ev);
+    }
+    py::object on_replace_ticks(const std::string& new_oid,const std::string& old_oid,
+                                char venue_code,const py::bytes& side_b,
+                                int32_t price_ticks,uint32_t qty){
+        BookEvent ev;
+        bool has = core_.replace(new_oid,old_oid,venue_of(venue_code),side_of(side_b),
+                                 price_ticks,qty,ev);
+        return event_or_none(has,ev);
+    }
+
+    /* ---------- batch API ---------- */
+    /* conflate=True: NBBO moves collapse to one tuple per side whose best
+       price or size changed, emitted after the batch's executions, with
+       old_px/old_sz holding the pre-batch NBBO and new_px None for a side
+       the batch emptied (ConflatingSink)                               */
+    py::list on_batch(py::iterable batch, bool conflate) {
+        events_.clear();
+        if (conflate) {
+            ConflatingSink<std::vector<BookEvent>> c(core_, events_);
+            run_batch(batch, c);
+            c.finish();
+        } else {
+            run_batch(batch, events_);
+        }
+        return events_list();
+    }
+
+    /* tuples are encoded under the GIL, then applied without it */
+    py::list on_batch_int(py::iterable batch, bool conflate) {
+        records_.clear();
+        for (auto item : batch) records_.push_back(encode(item.cast<py::tuple>()));
+        return apply_to_list(records_.data(), records_.size(), conflate);
+    }
+
+    /* records: 1-D structured array of msg_dtype, or any contiguous buffer
+       of packed MsgRecords; applied in one loop with the GIL released    */
+    py::list on_batch_array(py::buffer records, bool conflate) {
+        auto view = record_view<MsgRecord>(records);
+        const MsgRecord* recs = view.recs;
+        size_t n = view.n;
+        return apply_to_list(recs, n, conflate);
+    }
+
+    /* data: bytes/memoryview/mmap of wire-format messages (feed_decoder.hpp),
+       decoded straight into the book with the GIL released              */
+    py::list on_binary(py::buffer data, bool conflate) {
+        py::buffer_info info = data.request();
+        const auto* buf = static_cast<const uint8_t*>(info.ptr);
+        size_t len = size_t(info.size * info.itemsize);
+        wire::DecodeResult res;
+        events_.clear();
+        {
+            py::gil_scoped_release nogil;
+            if (conflate) {
+                ConflatingSink<std::vector<BookEvent>> c(core_, events_);
+                res = wire::decode(buf, len, core_, c);
+                c.finish();
+            } else {
+                res = wire::decode(buf, len, core_, events_);
+            }
+        }
+        if (res.bytes != len)
+            throw py::value_error("truncated message at offset " + std::to_string(res.bytes));
+        return events_list();
+    }
+
+    /* ---------- callback sink ---------- */
+    /* route submit_* events to fn(events), events an event_dtype array
+       of up to batch_events rows (prices in ticks, kind in event_type).
+       Pending events go to the old callback first; None unregisters.   */
+    void set_event_callback(py::object fn, size_t batch_events) {
+        if (batcher_) batcher_->flush();
+        batcher_.reset();
+        callback_.reset();
+        if (fn.is_none()) return;
+        callback_ = std::make_unique<PyCallbackSink>(std::move(fn));
+        batcher_  = std::make_unique<BatchingSink>(*callback_, batch_events);
+    }
+
+    /* like on_batch_array / on_binary, but events go to the callback, a
+       full batch at a time, instead of into a returned list.  flush=True
+       also delivers the remainder before returning; otherwise it waits
+       for the next batch or flush_events().  Returns the event count.
+       A callback that raises stops the batch at that message.          */
+    size_t submit_array(py::buffer records, bool conflate, bool flush) {
+        auto view = record_view<MsgRecord>(records);
+        const MsgRecord* recs = view.recs;
+        size_t n = view.n;
+        return submit([&](auto& sink){ core_.apply(recs, n, sink); }, conflate, flush);
+    }
+    size_t submit_binary(py::buffer data, bool conflate, bool flush) {
+        py::buffer_info info = data.request();
+        const auto* buf = static_cast<const uint8_t*>(info.ptr);
+        size_t len = size_t(info.size * info.itemsize);
+        wire::DecodeResult res{};
+        size_t events = submit([&](auto& sink){ res = wire::decode(buf, len, core_, sink); },
+                               conflate, flush);
+        if (res.bytes != len)
+            throw py::value_error("truncated message at offset " + std::to_string(res.bytes));
+        return events;
+    }
+    void flush_events() { if (batcher_) batcher_->flush(); }
+    size_t pending_events() const { return batcher_ ? batcher_->pending() : 0; }
+
+    /* stream a wire-format capture file through the book.  sink: None
+       (count only), a path (EventRecords, read back with event_dtype) or
+       a callable given the list of event tuples after every chunk.      */
+    py::dict replay(const std::string& path, py::object sink, size_t chunk_mb) {
+        struct NullSink { void push_back(const BookEvent&) {} };
+        size_t chunk = std::max<size_t>(chunk_mb, 1) << 20;
+        ReplayStats st;
+        if (sink.is_none()) {
+            NullSink null;
+            py::gil_scoped_release nogil;
+            st = ::replay(path, core_, null, chunk);
+        } else if (py::isinstance<py::str>(sink)) {
+            std::string out_path = sink.cast<std::string>();
+            py::gil_scoped_release nogil;
+            EventFileSink file(out_path);
+            st = ::replay(path, core_, file, [&]{ file.flush(); }, chunk);
+        } else {
+            events_.clear();
+            auto hand_over = [&]{
+                if (events_.empty()) return;
+                py::gil_scoped_acquire gil;
+                py::list out;
+                for (const auto& ev : events_) out.append(event_tuple(ev));
+                events_.clear();
+                sink(out);
+            };
+            py::gil_scoped_release nogil;
+            st = ::replay(path, core_, events_, hand_over, chunk);
+        }
         py::dict d;
-        auto it = levels_.find(idx);
-        if(it==levels_.end()) return d;
-        const auto& pl = it->second;
-        for(size_t i=0;i<NUM_VENUES;++i)
-            if(pl.vqty[i]) d[py::str(VENUES[i])] = pl.vqty[i];
+        d["messages"]     = st.messages;
+        d["events"]       = st.events;
+        d["bytes"]        = st.bytes;
+        d["seconds"]      = st.seconds;
+        d["msgs_per_sec"] = st.msgs_per_sec();
         return d;
     }
-};
 
-/* ---------- OrderBook ---------- */
-class OrderBook {
-    SideBook bid_{true};
-    SideBook ask_{false};
+    /* columnar variant: events are written row by row into the given
+       arrays (one row per event, at most one event per record); returns
+       the number of rows written                                        */
+    template<class P>
+    size_t on_batch_array_into(py::buffer records,
+                               column<uint8_t>  event_type,
+                               column<P>        price,
+                               column<uint32_t> agg,
+                               column<P>        old_price,
+                               column<uint32_t> old_agg,
+                               column<uint16_t> venue_mask,
+                               column<uint32_t> venue_qty,
+                               bool conflate) {
+        auto view = record_view<MsgRecord>(records);
+        const MsgRecord* recs = view.recs;
+        size_t n = view.n;
+        /* conflated output: every record may execute, plus an NBBO per side */
+        auto sink = column_sink(conflate ? n+2 : n, event_type, price, agg, old_price,
+                                old_agg, venue_mask, venue_qty);
+        sink.scale = scale_;
+        {
+            py::gil_scoped_release nogil;
+            if (conflate) core_.apply_conflated(recs, n, sink);
+            else          core_.apply(recs, n, sink);
+        }
+        return sink.n;
+    }
 
-    struct Meta{ SideBook* sb; int idx; size_t vid; uint32_t qty; };
-    std::unordered_map<std::string,Meta> omap_;
 
-    /* helper to build NBBO-improvement tuple */
-    py::object nbbo_tuple(SideBook& sb, int new_idx, int old_idx) {
-        const auto& new_pl = sb.levels().at(new_idx);
-        const auto& old_pl = sb.levels().at(old_idx);
-        return py::make_tuple(
-            i2p(new_idx), new_pl.agg,
-            i2p(old_idx), old_pl.agg,
-            venue_string(old_pl)             // <── concatenated string
-        );
+    /* ---------- utilities ---------- */
+    py::object best_bid() const { return best_or_none(core_, Side::Bid, &scale_); }
+    py::object best_ask() const { return best_or_none(core_, Side::Ask, &scale_); }
+    py::object best_bid_ticks() const { return best_or_none(core_, Side::Bid, nullptr); }
+    py::object best_ask_ticks() const { return best_or_none(core_, Side::Ask, nullptr); }
+    py::dict snapshot_ticks(const py::bytes& side_b,int32_t price_ticks) const {
+        py::dict d;
+        const PriceLevel* pl = core_.find(side_of(side_b), price_ticks);
+        if(!pl) return d;
+        for(uint16_t m = pl->mask; m; m &= m-1){         /* quoting venues only */
+            size_t i = size_t(__builtin_ctz(m));
+            d[py::str(VENUES[i])] = pl->vqty[i];
+        }
+        return d;
+    }
+    py::dict snapshot(const py::bytes& side_b,double price) const {
+        return snapshot_ticks(side_b, scale_.to_ticks(price));
     }
-    /* alphabetically-sorted concatenation of venues with qty > 0  */
-    static std::string venue_string(const PriceLevel& pl) {
-        std::string out;
-        for (size_t i = 0; i < NUM_VENUES; ++i)
-            if (pl.vqty[i]) out.push_back(VENUE_CODE[i]);
-        std::sort(out.begin(), out.end());        // alphabetical
-        return out;                               // e.g. "CNX"
+    /* bit i set iff VENUES[i] rests at that price */
+    uint16_t venue_mask_ticks(const py::bytes& side_b,int32_t price_ticks) const {
+        const PriceLevel* pl = core_.find(side_of(side_b), price_ticks);
+        return pl ? pl->mask : 0;
+    }
+    uint16_t venue_mask(const py::bytes& side_b,double price) const {
+        return venue_mask_ticks(side_b, scale_.to_ticks(price));
+    }
+    /* ---------- aggregates ---------- */
+    uint64_t total_qty(const py::bytes& side_b) const   { return core_.total_qty(side_of(side_b)); }
+    size_t   level_count(const py::bytes& side_b) const { return core_.level_count(side_of(side_b)); }
+    /* qty at the best and up to ticks worse */
+    uint64_t depth_within(const py::bytes& side_b, int ticks) const {
+        return core_.depth_within(side_of(side_b), ticks);
+    }
+    /* sweeping qty from the touch: (vwap, filled, worst price); vwap and
+       worst are None on an empty side, filled < qty if the side runs out */
+    py::tuple vwap(const py::bytes& side_b, uint64_t qty) const {
+        FillEstimate f = core_.fill(side_of(side_b), qty);
+        if (!f.qty) return py::make_tuple(py::none(), 0, py::none());
+        double avg = double(f.notional) / double(f.qty);
+        py::object px = int_prices_ ? py::object(py::float_(avg)) : py::object(py::float_(avg * scale_.tick));
+        return py::make_tuple(px, f.qty, price_obj(f.worst, out_scale()));
     }
-    public:
-    OrderBook() = default;
 
-    /* ---------- single-message API ---------- */
-    py::object on_add(const std::string& oid,const char venue_code,,
-                      const py::bytes& side_b,double price,uint32_t qty){
-        bool bid = side_b==py::bytes("BID");
-        SideBook& sb = bid? bid_ : ask_;
-        int idx = p2i(price);
-        size_t vid = VENUE_MAP.at(venue_code);
+    /* ---------- depth view ---------- */
+    /* maintain the top n levels per side; deltas queue until drained */
+    void enable_depth(size_t n) { core_.enable_depth(n); }
 
-        int prev_best = sb.add(idx,vid,qty);
-        omap_[oid] = {&sb,idx,vid,qty};
+    /* current view, best first: [(price, agg, venues), ...] */
+    py::list depth(const py::bytes& side_b) const {
+        Side s = side_of(side_b);
+        const DepthView& dv = core_.depth();
+        py::list out;
+        for (size_t i = 0; i < dv.count(s); ++i) {
+            const DepthLevel& l = dv.level(s, i);
+            out.append(py::make_tuple(price_obj(l.price, out_scale()), l.agg, venue_str(l.mask)));
+        }
+        return out;
+    }
 
-        if(prev_best!=std::numeric_limits<int>::min())
-            return nbbo_tuple(sb,idx,prev_best);
-        return py::none();
+    /* queued DepthDelta records as a depth_delta_dtype array (prices in
+       ticks); drains the queue                                          */
+    py::array_t<DepthDelta> depth_deltas() { return drain(core_.depth().deltas()); }
+
+    /* ---------- per-venue BBO ---------- */
+    /* track each venue's own best bid/offer and lock/cross transitions */
+    void enable_venue_bbo(bool on) { core_.enable_venue_bbo(on); }
+
+    /* {venue code: (price, qty)} for venues quoting on side */
+    py::dict venue_bbo(const py::bytes& side_b) const {
+        Side s = side_of(side_b);
+        py::dict out;
+        for (size_t v = 0; v < NUM_VENUES; ++v) {
+            const VenueBbo& b = core_.venue_bbo().bbo(s, Venue(v));
+            if (b.price != NO_TICK)
+                out[py::str(std::string(1, VENUE_CODE[v]))] = py::make_tuple(price_obj(b.price, out_scale()), b.qty);
+        }
+        return out;
     }
+    int market_state() const { return int(core_.venue_bbo().market()); }
 
-    void on_cancel(const std::string& oid){
-        auto it=omap_.find(oid); if(it==omap_.end()) return;
-        auto m=it->second; omap_.erase(it);
-        m.sb->remove(m.idx,m.vid,m.qty);
+    /* queued VenueBboDelta / MarketChange records (prices in ticks);
+       each call drains its queue                                        */
+    py::array_t<VenueBboDelta> venue_bbo_deltas() { return drain(core_.venue_bbo().deltas()); }
+    py::array_t<MarketChange>  market_changes()   { return drain(core_.venue_bbo().market_changes()); }
+
+    /* in-book latency and counters; all zero unless built with
+       -DORDERBOOK_STATS (see STATS_ENABLED)                            */
+    py::dict stats() const {
+        BookStats st = core_.stats();
+        double cpn = STATS_ENABLED ? cycles_per_ns() : 1.0;
+        static const char* const OPS[NUM_OPS] = {"add", "cancel", "replace", "execute"};
+        py::dict lat;
+        for (size_t i = 0; i < NUM_OPS; ++i) lat[OPS[i]] = hist_dict(st.latency[i], cpn);
+        auto map_dict = [](const MapCounters& c){
+            py::dict d;
+            d["lookups"] = c.lookups;
+            d["probes"]  = c.probes;
+            return d;
+        };
+        py::dict d;
+        d["enabled"]        = STATS_ENABLED;
+        d["cycles_per_ns"]  = cpn;
+        d["latency"]        = lat;
+        d["level_creates"]  = st.levels.creates;
+        d["level_deletes"]  = st.levels.deletes;
+        d["best_rescans"]   = st.levels.rescans;
+        d["sparse_hits"]    = st.levels.sparse_hits;
+        d["recentres"]      = st.levels.recentres;
+        d["int_orders"]     = map_dict(st.int_orders);
+        d["string_orders"]  = map_dict(st.string_orders);
+        return d;
     }
+    void reset_stats() { core_.reset_stats(); }
 
-    py::object on_replace(const std::string& new_oid,const std::string& old_oid,
-                          char venue_code,const py::bytes& side_b,
-                          double price,uint32_t qty){
-        auto res=on_add(new_oid,venue_code,side_b,price,qty);
-        on_cancel(old_oid);
-        return res;
+    /* allocator usage: node pools behind sparse levels and string oids */
+    py::dict pool_stats() const {
+        BookPoolStats st = core_.pool_stats();
+        py::dict d;
+        d["bid_levels"]      = pool_dict(st.bid_levels);
+        d["ask_levels"]      = pool_dict(st.ask_levels);
+        d["string_orders"]   = pool_dict(st.string_orders);
+        d["int_order_slots"] = st.int_order_slots;
+        return d;
+    }
+    /* ---------- snapshots ---------- */
+    /* seq is the caller's feed position; load_snapshot hands it back */
+    void save_snapshot(const std::string& path, uint64_t seq) const {
+        py::gil_scoped_release nogil;
+        ::save_snapshot(path, core_, seq);
+    }
+    uint64_t load_snapshot(const std::string& path) {
+        py::gil_scoped_release nogil;
+        return ::load_snapshot(path, core_);
     }
+    /* periodic snapshots to path, written on a background thread */
+    void start_snapshots(const std::string& path) { snapshots_.reset(new SnapshotWriter(path)); }
+    void offer_snapshot(uint64_t seq)             { offer_to(snapshots_, core_, seq); }
+    uint64_t flush_snapshots()                    { return flush_writer(snapshots_); }
+};
 
-    py::object on_execute(const std::string& oid, uint32_t exec_qty) {
-        auto it = omap_.find(oid);
-        if (it == omap_.end()) return py::none();
+/* ---------- BookManager  (Python adapter) ---------- */
+class PyBookManager {
+    BookManager mgr_;
+    TickTable   ticks_;                          /* prices in and out   */
+    std::vector<RoutedEvent> events_;            /* scratch for batches */
+    std::unique_ptr<SnapshotWriter> snapshots_;
+    std::unique_ptr<NbboShmWriter>  shm_;        /* shared NBBO table   */
 
-        Meta& m   = it->second;
-        uint32_t take = std::min(exec_qty, m.qty);
-        m.qty    -= take;
-        m.sb->remove(m.idx, m.vid, take);
+    /* mgr_.apply, refreshing the shared table per message when publishing */
+    template<class Sink>
+    void apply(const RoutedMsg* msgs, size_t n, Sink& out) {
+        if (shm_) apply_published(mgr_, msgs, n, out, *shm_);
+        else      mgr_.apply(msgs, n, out);
+    }
 
-        const PriceLevel& pl = m.sb->levels().at(m.idx);
-        py::list per_venue;
-        for (auto q : pl.vqty) per_venue.append(q);
+    public:
+    explicit PyBookManager(size_t reserve) { mgr_.reserve(reserve); }
 
-        std::string venues = venue_string(pl);
+    void open(uint32_t instrument)  { mgr_.open(instrument); }
+    void close(uint32_t instrument) {
+        mgr_.close(instrument);
+        if (shm_ && instrument < shm_->instruments()) shm_->publish(instrument, TopOfBook{});
+    }
 
-        if (m.qty == 0) omap_.erase(it);
+    /* ---------- shared-memory NBBO ---------- */
+    /* (re)create segment name with rows for ids < instruments and, if
+       ring_slots, a broadcast ring; every batch then keeps it current  */
+    void publish_shm(const std::string& name, uint32_t instruments, size_t ring_slots) {
+        shm_.reset();
+        shm_ = std::make_unique<NbboShmWriter>(name, instruments, ring_slots);
+        shm_->publish_all(mgr_);
+    }
+    void stop_shm() { shm_.reset(); }
+    size_t size() const             { return mgr_.size(); }
+    void set_tick_size(uint32_t instrument, double tick) { ticks_.set(instrument, tick); }
+    double tick_size(uint32_t instrument) const          { return ticks_[instrument].tick; }
 
-        /* exec_price, total_remaining, qty_list, venue_str  (len == 4) */
-        return py::make_tuple(i2p(m.idx), pl.agg, per_venue, venues);
+    /* records: routed_msg_dtype array; returns [(instrument, payload), ...] */
+    py::list on_batch_array(py::buffer records) {
+        auto view = record_view<RoutedMsg>(records);
+        const RoutedMsg* msgs = view.recs;
+        size_t n = view.n;
+        events_.clear();
+        {
+            py::gil_scoped_release nogil;
+            apply(msgs, n, events_);
+        }
+        py::list out;
+        for (const auto& e : events_)
+            out.append(py::make_tuple(e.instrument, event_tuple(e.ev, &ticks_[e.instrument])));
+        return out;
     }
-    /* ---------- batch API ---------- */
-/* ---------- batch API ---------- */
-    py::list on_batch(py::iterable batch) {
+
+    template<class P>
+    size_t on_batch_array_into(py::buffer records,
+                               column<uint32_t> instrument,
+                               column<uint8_t>  event_type,
+                               column<P>        price,
+                               column<uint32_t> agg,
+                               column<P>        old_price,
+                               column<uint32_t> old_agg,
+                               column<uint16_t> venue_mask,
+                               column<uint32_t> venue_qty) {
+        auto view = record_view<RoutedMsg>(records);
+        const RoutedMsg* msgs = view.recs;
+        size_t n = view.n;
+        if (instrument.ndim() < 1 || size_t(instrument.shape(0)) < n)
+            throw py::value_error("output columns shorter than the batch");
+        BasicRoutedColumnSink<P> sink{column_sink(n, event_type, price, agg, old_price,
+                                                  old_agg, venue_mask, venue_qty),
+                                      instrument.mutable_data(), &ticks_};
+        {
+            py::gil_scoped_release nogil;
+            apply(msgs, n, sink);
+        }
+        return sink.n;
+    }
+
+    py::object best(uint32_t instrument, Side s, bool ticks) const {
+        const OrderBookCore* b = mgr_.find(instrument);
+        if (!b) return py::none();
+        return best_or_none(*b, s, ticks ? nullptr : &ticks_[instrument]);
+    }
+    py::object best_bid(uint32_t instrument) const       { return best(instrument, Side::Bid, false); }
+    py::object best_ask(uint32_t instrument) const       { return best(instrument, Side::Ask, false); }
+    py::object best_bid_ticks(uint32_t instrument) const { return best(instrument, Side::Bid, true); }
+    py::object best_ask_ticks(uint32_t instrument) const { return best(instrument, Side::Ask, true); }
+
+    /* ---------- snapshots (every open instrument; tick sizes are not saved) ---------- */
+    void save_snapshot(const std::string& path, uint64_t seq) const {
+        py::gil_scoped_release nogil;
+        ::save_snapshot(path, mgr_, seq);
+    }
+    uint64_t load_snapshot(const std::string& path) {
+        py::gil_scoped_release nogil;
+        uint64_t seq = ::load_snapshot(path, mgr_);
+        if (shm_) shm_->publish_all(mgr_);
+        return seq;
+    }
+    void start_snapshots(const std::string& path) { snapshots_.reset(new SnapshotWriter(path)); }
+    void offer_snapshot(uint64_t seq)             { offer_to(snapshots_, mgr_, seq); }
+    uint64_t flush_snapshots()                    { return flush_writer(snapshots_); }
+};
+
+/* ---------- ShardedBookManager  (Python adapter) ---------- */
+class PyShardedManager {
+    ShardedBookManager mgr_;
+    TickTable          ticks_;                   /* prices out          */
+    std::vector<RoutedEvent> events_;            /* scratch for batches */
+
+    void check_errors(uint64_t before) const {
+        uint64_t now = mgr_.errors();
+        if (now != before)
+            throw std::runtime_error(std::to_string(now-before) + " messages rejected");
+    }
+
+    public:
+    PyShardedManager(size_t shards, const std::vector<int>& cpus, size_t ring_capacity)
+        : mgr_(shards, cpus, ring_capacity) {}
+
+    size_t shards() const { return mgr_.shards(); }
+    void set_tick_size(uint32_t instrument, double tick) { ticks_.set(instrument, tick); }
+    double tick_size(uint32_t instrument) const          { return ticks_[instrument].tick; }
+
+    /* same contract as BookManager.on_batch_array; events of different
+       shards interleave, events of one instrument stay in order         */
+    py::list on_batch_array(py::buffer records) {
+        auto view = record_view<RoutedMsg>(records);
+        const RoutedMsg* msgs = view.recs;
+        size_t n = view.n;
+        uint64_t errs = mgr_.errors();
+        events_.clear();
+        {
+            py::gil_scoped_release nogil;
+            mgr_.apply(msgs, n, events_);
+        }
+        check_errors(errs);
         py::list out;
-        out.reserve(py::len(batch));              // pre-allocate Python list
+        for (const auto& e : events_)
+            out.append(py::make_tuple(e.instrument, event_tuple(e.ev, &ticks_[e.instrument])));
+        return out;
+    }
 
-        for (auto item : batch) {
-            auto t   = item.cast<py::tuple>();
-            std::string cmd = t[0].cast<std::string>();
+    template<class P>
+    size_t on_batch_array_into(py::buffer records,
+                               column<uint32_t> instrument,
+                               column<uint8_t>  event_type,
+                               column<P>        price,
+                               column<uint32_t> agg,
+                               column<P>        old_price,
+                               column<uint32_t> old_agg,
+                               column<uint16_t> venue_mask,
+                               column<uint32_t> venue_qty) {
+        auto view = record_view<RoutedMsg>(records);
+        const RoutedMsg* msgs = view.recs;
+        size_t n = view.n;
+        if (instrument.ndim() < 1 || size_t(instrument.shape(0)) < n)
+            throw py::value_error("output columns shorter than the batch");
+        BasicRoutedColumnSink<P> sink{column_sink(n, event_type, price, agg, old_price,
+                                                  old_agg, venue_mask, venue_qty),
+                                      instrument.mutable_data(), &ticks_};
+        uint64_t errs = mgr_.errors();
+        {
+            py::gil_scoped_release nogil;
+            mgr_.apply(msgs, n, sink);
+        }
+        check_errors(errs);
+        return sink.n;
+    }
+};
 
-            if (cmd == "add") {
-                py::object res = on_add(
-                    t[1].cast<std::string>(),     // oid
-                    t[2].cast<char>(),     // venue
-                    t[3].cast<py::bytes>(),       // side
-                    t[4].cast<double>(),          // price
-                    t[5].cast<uint32_t>()         // qty
-                );
-                if (!res.is_none())
-                    out.append(res);
+/* ---------- NbboShmReader  (Python adapter) ---------- */
+class PyNbboReader {
+    NbboShmReader reader_;
+    std::vector<NbboUpdate> scratch_;
 
-            } else if (cmd == "execute") {
-                py::object res = on_execute(
-                    t[1].cast<std::string>(),     // oid
-                    t[2].cast<uint32_t>()         // exec_qty
-                );
-                if (!res.is_none())
-                    out.append(res);
+    public:
+    PyNbboReader(const std::string& name, bool from_start) : reader_(name, from_start) {}
 
-            } else if (cmd == "cancel") {
-                on_cancel(t[1].cast<std::string>());   // nothing to append
+    uint32_t instruments() const { return reader_.instruments(); }
+    uint64_t lost() const        { return reader_.lost(); }
 
-            } else if (cmd == "replace") {
-                py::object res = on_replace(
-                    t[1].cast<std::string>(),     // new_oid
-                    t[2].cast<std::string>(),     // old_oid
-                    t[3].cast<char>(),     // venue
-                    t[4].cast<py::bytes>(),       // side
-                    t[5].cast<double>(),          // price
-                    t[6].cast<uint32_t>()         // qty
-                );
-                if (!res.is_none())
-                    out.append(res);
+    /* (bid_ticks, bid_qty, bid_venues, ask_ticks, ask_qty, ask_venues,
+       updates); empty sides read None, 0, ""                          */
+    py::object top(uint32_t instrument) const {
+        TopOfBook t;
+        if (instrument >= reader_.instruments()) throw py::index_error("instrument beyond the NBBO table");
+        if (!reader_.read(instrument, t)) throw std::runtime_error("NBBO row stayed busy; writer stalled?");
+        return py::make_tuple(price_obj(t.bid_ticks, nullptr), t.bid_qty, venue_str(t.bid_mask),
+                              price_obj(t.ask_ticks, nullptr), t.ask_qty, venue_str(t.ask_mask),
+                              t.updates);
+    }
 
-            } else {
-                throw std::runtime_error("Bad cmd");
-            }
+    /* ring records since the last poll, as an nbbo_update_dtype array */
+    py::array_t<NbboUpdate> poll(size_t max) {
+        scratch_.resize(max);
+        size_t n;
+        {
+            py::gil_scoped_release nogil;
+            n = reader_.poll(scratch_.data(), max);
         }
-        return out;                               // list may be shorter than batch
+        py::array_t<NbboUpdate> out(n);
+        std::copy(scratch_.begin(), scratch_.begin() + n, out.mutable_data());
+        return out;
     }
+};
 
+/* ---------- BookFeed  (Python adapter) ---------- */
+/* Python only reads the event ring; records normally arrive from a native
+   feed handler that got the input ring through input_ring()            */
+class PyBookFeed {
+    BookFeed  feed_;
+    TickScale scale_;
+    std::vector<BookEvent> events_;              /* scratch for poll */
 
-    /* ---------- utilities ---------- */
-    py::object best_bid() const {
-        double p=bid_.best_price(); return std::isnan(p)?py::none():py::float_(p);
+    public:
+    PyBookFeed(size_t in_capacity, size_t out_capacity, double tick_size)
+        : feed_(in_capacity, out_capacity), scale_(tick_size) {}
+
+    void start(int cpu) { feed_.start(cpu); }
+    void stop() {
+        py::gil_scoped_release nogil;
+        feed_.stop();
     }
-    py::object best_ask() const {
-        double p=ask_.best_price(); return std::isnan(p)?py::none():py::float_(p);
+    bool running() const      { return feed_.running(); }
+    uint64_t applied() const  { return feed_.applied(); }
+    uint64_t errors() const   { return feed_.errors(); }
+
+    /* borrowed SpscRing<MsgRecord>* for a native producer */
+    py::capsule input_ring() {
+        return py::capsule(static_cast<void*>(&feed_.input()), "pyorderbook.MsgRing");
     }
-    py::dict snapshot(const py::bytes& side_b,double price) const {
-        const SideBook& sb=(side_b==py::bytes("BID"))?bid_:ask_;
-        return sb.snapshot(p2i(price));
+
+    /* push records from Python (tests / replays); returns how many fit */
+    size_t publish_array(py::buffer records) {
+        auto view = record_view<MsgRecord>(records);
+        const MsgRecord* recs = view.recs;
+        size_t n = view.n;
+        py::gil_scoped_release nogil;
+        return feed_.input().push_batch(recs, n);
+    }
+
+    /* run the consumer loop inline when no thread was started; stops
+       early when the event ring is full, so poll() and pump again     */
+    size_t pump(size_t max) {
+        if (feed_.running()) throw std::runtime_error("consumer thread is running");
+        py::gil_scoped_release nogil;
+        return feed_.pump(max);
+    }
+
+    py::list poll(size_t max) {
+        events_.resize(max);
+        size_t n;
+        {
+            py::gil_scoped_release nogil;
+            n = feed_.events().pop_batch(events_.data(), max);
+        }
+        py::list out;
+        for (size_t i = 0; i < n; ++i) out.append(event_tuple(events_[i], &scale_));
+        return out;
+    }
+
+    /* drain up to len(event_type) events into columns; returns the count */
+    template<class P>
+    size_t poll_into(column<uint8_t>  event_type,
+                     column<P>        price,
+                     column<uint32_t> agg,
+                     column<P>        old_price,
+                     column<uint32_t> old_agg,
+                     column<uint16_t> venue_mask,
+                     column<uint32_t> venue_qty) {
+        size_t rows = event_type.ndim() >= 1 ? size_t(event_type.shape(0)) : 0;
+        auto sink = column_sink(rows, event_type, price, agg, old_price,
+                                old_agg, venue_mask, venue_qty);
+        sink.scale = scale_;
+        py::gil_scoped_release nogil;
+        BookEvent ev;
+        while (sink.n < rows && feed_.events().try_pop(ev)) sink.push_back(ev);
+        return sink.n;
     }
 };
 
+/* msg_dtype records → wire-format bytes (test data, capture files) */
+static py::bytes encode_records(py::buffer records) {
+    auto view = record_view<MsgRecord>(records);
+    const MsgRecord* recs = view.recs;
+    size_t n = view.n;
+    std::string out(n * wire::MAX_MSG, '\0');
+    size_t len = 0;
+    for (size_t i = 0; i < n; ++i)
+        len += wire::encode(recs[i], reinterpret_cast<uint8_t*>(&out[len]));
+    return py::bytes(out.data(), len);
+}
+
 /* ---------- bindings ---------- */
 PYBIND11_MODULE(pyorderbook, m){
     using namespace py::literals;
+    PYBIND11_NUMPY_DTYPE(MsgRecord, msg_type, oid, old_oid, venue, side,
+                         price_ticks, qty);
+    PYBIND11_NUMPY_DTYPE(RoutedMsg, instrument, msg_type, oid, old_oid, venue,
+                         side, price_ticks, qty);
+    PYBIND11_NUMPY_DTYPE(EventRecord, event_type, price_ticks, agg,
+                         old_price_ticks, old_agg, venue_mask, venue_qty);
+    m.attr("msg_dtype")   = py::dtype::of<MsgRecord>();
+    m.attr("routed_msg_dtype") = py::dtype::of<RoutedMsg>();
+    PYBIND11_NUMPY_DTYPE(DepthDelta, side, level, price_ticks, agg, venue_mask);
+    m.attr("event_dtype") = py::dtype::of<EventRecord>();
+    PYBIND11_NUMPY_DTYPE(VenueBboDelta, side, venue, price_ticks, qty);
+    PYBIND11_NUMPY_DTYPE(MarketChange, state, bid_ticks, ask_ticks, bid_mask, ask_mask);
+    m.attr("depth_delta_dtype") = py::dtype::of<DepthDelta>();
+    m.attr("venue_bbo_delta_dtype") = py::dtype::of<VenueBboDelta>();
+    m.attr("market_change_dtype") = py::dtype::of<MarketChange>();
+    PYBIND11_NUMPY_DTYPE(NbboUpdate, seq, instrument, side, price_ticks, qty, venue_mask);
+    m.attr("nbbo_update_dtype") = py::dtype::of<NbboUpdate>();
+    m.attr("MKT_NORMAL")  = int(MKT_NORMAL);
+    m.attr("MKT_LOCKED")  = int(MKT_LOCKED);
+    m.attr("MKT_CROSSED") = int(MKT_CROSSED);
+    m.attr("MAX_DEPTH")   = MAX_DEPTH;
+    m.attr("MSG_ADD")     = int(MSG_ADD);
+    m.attr("MSG_CANCEL")  = int(MSG_CANCEL);
+    m.attr("MSG_REPLACE") = int(MSG_REPLACE);
+    m.attr("MSG_EXECUTE") = int(MSG_EXECUTE);
+    m.attr("SIDE_BID")    = int(Side::Bid);
+    m.attr("SIDE_ASK")    = int(Side::Ask);
+    m.attr("VENUE_CODES") = std::string(VENUE_CODE.begin(), VENUE_CODE.end());
+    m.attr("EV_NBBO")     = int(EV_NBBO);
+    m.attr("EV_EXEC")     = int(EV_EXEC);
+    m.attr("DEFAULT_TICK") = DEFAULT_TICK;
+    m.attr("NO_TICK")     = NO_TICK;
+    m.attr("STATS_ENABLED") = STATS_ENABLED;
+    m.attr("VENUE_SIMD")  = VENUE_SIMD;
+    m.def("encode_records", &encode_records, "records"_a);
+    m.def("unlink_shm", &NbboShmWriter::unlink, "name"_a);
+    m.def("venue_string", [](uint16_t mask) {
+        if (mask >> NUM_VENUES) throw py::value_error("venue mask has bits past the last venue");
+        return venue_str(mask);
+    }, "venue_mask"_a);
+
     py::class_<OrderBook>(m,"OrderBook")
-        .def(py::init<>())
-        .def("on_add",     &OrderBook::on_add,
+        .def(py::init<double,bool>(),"tick_size"_a=DEFAULT_TICK,"int_prices"_a=false)
+        .def_property_readonly("tick_size", &OrderBook::tick_size)
+        .def("on_add",     py::overload_cast<uint64_t,char,const py::bytes&,double,uint32_t>(&OrderBook::on_add),
              "oid"_a,"venue"_a,"side"_a,"price"_a,"qty"_a)
-        .def("on_cancel",  &OrderBook::on_cancel,"oid"_a)
-        .def("on_replace", &OrderBook::on_replace,
+        .def("on_add",     py::overload_cast<const std::string&,char,const py::bytes&,double,uint32_t>(&OrderBook::on_add),
+             "oid"_a,"venue"_a,"side"_a,"price"_a,"qty"_a)
+        .def("on_cancel",  py::overload_cast<uint64_t>(&OrderBook::on_cancel),"oid"_a)
+        .def("on_cancel",  py::overload_cast<const std::string&>(&OrderBook::on_cancel),"oid"_a)
+        .def("on_replace", py::overload_cast<uint64_t,uint64_t,char,const py::bytes&,double,uint32_t>(&OrderBook::on_replace),
+             "new_oid"_a,"old_oid"_a,"venue"_a,"side"_a,"price"_a,"qty"_a)
+        .def("on_replace", py::overload_cast<const std::string&,const std::string&,char,const py::bytes&,double,uint32_t>(&OrderBook::on_replace),
              "new_oid"_a,"old_oid"_a,"venue"_a,"side"_a,"price"_a,"qty"_a)
-        .def("on_execute", &OrderBook::on_execute,"oid"_a,"exec_qty"_a)
-        .def("on_batch",   &OrderBook::on_batch,"batch"_a)
+        .def("on_execute", py::overload_cast<uint64_t,uint32_t>(&OrderBook::on_execute),"oid"_a,"exec_qty"_a)
+        .def("on_execute", py::overload_cast<const std::string&,uint32_t>(&OrderBook::on_execute),"oid"_a,"exec_qty"_a)
+        .def("cancel_venue", &OrderBook::cancel_venue,"venue_code"_a)
+        .def("clear_side", &OrderBook::clear_side,"side"_a)
+        .def("cancel_all", &OrderBook::cancel_all)
+        .def("on_add_ticks", py::overload_cast<uint64_t,char,const py::bytes&,int32_t,uint32_t>(&OrderBook::on_add_ticks),
+             "oid"_a,"venue"_a,"side"_a,"price_ticks"_a,"qty"_a)
+        .def("on_add_ticks", py::overload_cast<const std::string&,char,const py::bytes&,int32_t,uint32_t>(&OrderBook::on_add_ticks),
+             "oid"_a,"venue"_a,"side"_a,"price_ticks"_a,"qty"_a)
+        .def("on_replace_ticks", py::overload_cast<uint64_t,uint64_t,char,const py::bytes&,int32_t,uint32_t>(&OrderBook::on_replace_ticks),
+             "new_oid"_a,"old_oid"_a,"venue"_a,"side"_a,"price_ticks"_a,"qty"_a)
+        .def("on_replace_ticks", py::overload_cast<const std::string&,const std::string&,char,const py::bytes&,int32_t,uint32_t>(&OrderBook::on_replace_ticks),
+             "new_oid"_a,"old_oid"_a,"venue"_a,"side"_a,"price_ticks"_a,"qty"_a)
+        .def("on_batch",   &OrderBook::on_batch,"batch"_a,"conflate"_a=false)
+        .def("set_event_callback", &OrderBook::set_event_callback,"callback"_a,"batch_events"_a=256)
+        .def("submit_array", &OrderBook::submit_array,"records"_a,"conflate"_a=false,"flush"_a=true)
+        .def("submit_binary", &OrderBook::submit_binary,"data"_a,"conflate"_a=false,"flush"_a=true)
+        .def("flush_events", &OrderBook::flush_events)
+        .def_property_readonly("pending_events", &OrderBook::pending_events)
+        .def("on_batch_int", &OrderBook::on_batch_int,"batch"_a,"conflate"_a=false)
+        .def("on_batch_array", &OrderBook::on_batch_array,"records"_a,"conflate"_a=false)
+        .def("on_binary",  &OrderBook::on_binary,"data"_a,"conflate"_a=false)
+        .def("replay",     &OrderBook::replay,"path"_a,"sink"_a=py::none(),"chunk_mb"_a=64)
+        .def("on_batch_array_into", &OrderBook::on_batch_array_into<double>,
+             "records"_a, py::arg("event_type").noconvert(),
+             py::arg("price").noconvert(), py::arg("agg").noconvert(),
+             py::arg("old_price").noconvert(), py::arg("old_agg").noconvert(),
+             py::arg("venue_mask").noconvert(), py::arg("venue_qty").noconvert(),
+             "conflate"_a=false)
+        .def("on_batch_array_into", &OrderBook::on_batch_array_into<int32_t>,
+             "records"_a, py::arg("event_type").noconvert(),
+             py::arg("price").noconvert(), py::arg("agg").noconvert(),
+             py::arg("old_price").noconvert(), py::arg("old_agg").noconvert(),
+             py::arg("venue_mask").noconvert(), py::arg("venue_qty").noconvert(),
+             "conflate"_a=false)
         .def("best_bid",   &OrderBook::best_bid)
         .def("best_ask",   &OrderBook::best_ask)
-        .def("snapshot",   &OrderBook::snapshot,"side"_a,"price"_a);
+        .def("best_bid_ticks", &OrderBook::best_bid_ticks)
+        .def("best_ask_ticks", &OrderBook::best_ask_ticks)
+        .def("snapshot",   &OrderBook::snapshot,"side"_a,"price"_a)
+        .def("snapshot_ticks", &OrderBook::snapshot_ticks,"side"_a,"price_ticks"_a)
+        .def("venue_mask", &OrderBook::venue_mask,"side"_a,"price"_a)
+        .def("venue_mask_ticks", &OrderBook::venue_mask_ticks,"side"_a,"price_ticks"_a)
+        .def("total_qty",  &OrderBook::total_qty,"side"_a)
+        .def("level_count", &OrderBook::level_count,"side"_a)
+        .def("depth_within", &OrderBook::depth_within,"side"_a,"ticks"_a)
+        .def("vwap",       &OrderBook::vwap,"side"_a,"qty"_a)
+        .def("enable_depth", &OrderBook::enable_depth,"n"_a)
+        .def("depth",      &OrderBook::depth,"side"_a)
+        .def("depth_deltas", &OrderBook::depth_deltas)
+        .def("enable_venue_bbo", &OrderBook::enable_venue_bbo,"on"_a=true)
+        .def("venue_bbo",  &OrderBook::venue_bbo,"side"_a)
+        .def("venue_bbo_deltas", &OrderBook::venue_bbo_deltas)
+        .def("market_state", &OrderBook::market_state)
+        .def("market_changes", &OrderBook::market_changes)
+        .def("pool_stats", &OrderBook::pool_stats)
+        .def("stats",      &OrderBook::stats)
+        .def("reset_stats", &OrderBook::reset_stats)
+        .def("save_snapshot", &OrderBook::save_snapshot,"path"_a,"seq"_a=0)
+        .def("load_snapshot", &OrderBook::load_snapshot,"path"_a)
+        .def("start_snapshots", &OrderBook::start_snapshots,"path"_a)
+        .def("offer_snapshot", &OrderBook::offer_snapshot,"seq"_a=0)
+        .def("flush_snapshots", &OrderBook::flush_snapshots);
+
+    py::class_<PyBookManager>(m,"BookManager")
+        .def(py::init<size_t>(),"reserve"_a=0)
+        .def("open",       &PyBookManager::open,"instrument"_a)
+        .def("close",      &PyBookManager::close,"instrument"_a)
+        .def("__len__",    &PyBookManager::size)
+        .def("on_batch_array", &PyBookManager::on_batch_array,"records"_a)
+        .def("on_batch_array_into", &PyBookManager::on_batch_array_into<double>,
+             "records"_a, py::arg("instrument").noconvert(),
+             py::arg("event_type").noconvert(),
+             py::arg("price").noconvert(), py::arg("agg").noconvert(),
+             py::arg("old_price").noconvert(), py::arg("old_agg").noconvert(),
+             py::arg("venue_mask").noconvert(), py::arg("venue_qty").noconvert())
+        .def("on_batch_array_into", &PyBookManager::on_batch_array_into<int32_t>,
+             "records"_a, py::arg("instrument").noconvert(),
+             py::arg("event_type").noconvert(),
+             py::arg("price").noconvert(), py::arg("agg").noconvert(),
+             py::arg("old_price").noconvert(), py::arg("old_agg").noconvert(),
+             py::arg("venue_mask").noconvert(), py::arg("venue_qty").noconvert())
+        .def("set_tick_size", &PyBookManager::set_tick_size,"instrument"_a,"tick"_a)
+        .def("tick_size",  &PyBookManager::tick_size,"instrument"_a)
+        .def("best_bid",   &PyBookManager::best_bid,"instrument"_a)
+        .def("best_ask",   &PyBookManager::best_ask,"instrument"_a)
+        .def("best_bid_ticks", &PyBookManager::best_bid_ticks,"instrument"_a)
+        .def("best_ask_ticks", &PyBookManager::best_ask_ticks,"instrument"_a)
+        .def("save_snapshot", &PyBookManager::save_snapshot,"path"_a,"seq"_a=0)
+        .def("load_snapshot", &PyBookManager::load_snapshot,"path"_a)
+        .def("start_snapshots", &PyBookManager::start_snapshots,"path"_a)
+        .def("offer_snapshot", &PyBookManager::offer_snapshot,"seq"_a=0)
+        .def("flush_snapshots", &PyBookManager::flush_snapshots)
+        .def("publish_shm", &PyBookManager::publish_shm,"name"_a,"instruments"_a,"ring_slots"_a=0)
+        .def("stop_shm",   &PyBookManager::stop_shm);
+
+    py::class_<PyNbboReader>(m,"NbboReader")
+        .def(py::init<const std::string&,bool>(),"name"_a,"from_start"_a=false)
+        .def_property_readonly("instruments", &PyNbboReader::instruments)
+        .def_property_readonly("lost", &PyNbboReader::lost)
+        .def("top",        &PyNbboReader::top,"instrument"_a)
+        .def("poll",       &PyNbboReader::poll,"max"_a=4096);
+
+    py::class_<PyShardedManager>(m,"ShardedBookManager")
+        .def(py::init<size_t,const std::vector<int>&,size_t>(),
+             "shards"_a, "cpus"_a=std::vector<int>{}, "ring_capacity"_a=size_t(1)<<16)
+        .def_property_readonly("shards", &PyShardedManager::shards)
+        .def("set_tick_size", &PyShardedManager::set_tick_size,"instrument"_a,"tick"_a)
+        .def("tick_size",  &PyShardedManager::tick_size,"instrument"_a)
+        .def("on_batch_array", &PyShardedManager::on_batch_array,"records"_a)
+        .def("on_batch_array_into", &PyShardedManager::on_batch_array_into<double>,
+             "records"_a, py::arg("instrument").noconvert(),
+             py::arg("event_type").noconvert(),
+             py::arg("price").noconvert(), py::arg("agg").noconvert(),
+             py::arg("old_price").noconvert(), py::arg("old_agg").noconvert(),
+             py::arg("venue_mask").noconvert(), py::arg("venue_qty").noconvert())
+        .def("on_batch_array_into", &PyShardedManager::on_batch_array_into<int32_t>,
+             "records"_a, py::arg("instrument").noconvert(),
+             py::arg("event_type").noconvert(),
+             py::arg("price").noconvert(), py::arg("agg").noconvert(),
+             py::arg("old_price").noconvert(), py::arg("old_agg").noconvert(),
+             py::arg("venue_mask").noconvert(), py::arg("venue_qty").noconvert());
+
+    py::class_<PyBookFeed>(m,"BookFeed")
+        .def(py::init<size_t,size_t,double>(),
+             "in_capacity"_a=size_t(1)<<16, "out_capacity"_a=size_t(1)<<16,
+             "tick_size"_a=DEFAULT_TICK)
+        .def("start",      &PyBookFeed::start,"cpu"_a=-1)
+        .def("stop",       &PyBookFeed::stop)
+        .def_property_readonly("running", &PyBookFeed::running)
+        .def_property_readonly("applied", &PyBookFeed::applied)
+        .def_property_readonly("errors",  &PyBookFeed::errors)
+        .def("input_ring", &PyBookFeed::input_ring)
+        .def("publish_array", &PyBookFeed::publish_array,"records"_a)
+        .def("pump",       &PyBookFeed::pump,"max"_a=SIZE_MAX)
+        .def("poll",       &PyBookFeed::poll,"max"_a=1024)
+        .def("poll_into",  &PyBookFeed::poll_into<double>,
+             py::arg("event_type").noconvert(),
+             py::arg("price").noconvert(), py::arg("agg").noconvert(),
+             py::arg("old_price").noconvert(), py::arg("old_agg").noconvert(),
+             py::arg("venue_mask").noconvert(), py::arg("venue_qty").noconvert())
+        .def("poll_into",  &PyBookFeed::poll_into<int32_t>,
+             py::arg("event_type").noconvert(),
+             py::arg("price").noconvert(), py::arg("agg").noconvert(),
+             py::arg("old_price").noconvert(), py::arg("old_agg").noconvert(),
+             py::arg("venue_mask").noconvert(), py::arg("venue_qty").noconvert());
 }
@@ -90,7 +90,7 @@ class DenseWindowSide:
         self._set(idx)
         if (self.is_bid and idx>self.best) or (not self.is_bid and idx<self.best):
             self.best=idx
-        return prev if prev!=self.initial else None
+        return prev if prev!=self.initial and self.best!=prev else None
     def dec_level(self, idx:int):
         self._clr(idx)
         if idx != self.best:
@@ -115,7 +115,6 @@ class DenseWindowSide:
     def best_price(self):
         if self.is_bid and self.best==-1: return None
         if (not self.is_bid) and self.best==float('inf'): return None
-        print(self.best, "h")
         return i2p(self.best)
 
 #######################################################################
@@ -164,20 +163,31 @@ class OrderBook:
                 return new_best,new_size,old_price,old_size,old_venues
     
     def on_cancel(self, oid):
-        side,idx,vid,qty=self.order_map.pop(oid)
+        self._remove(*self.order_map.pop(oid))
+
+    def _remove(self, side, idx, vid, qty):
         lvl=self.levels[side][idx]; lvl.adjust(vid,-qty)
         if lvl.agg_qty==0:
             self._idx_obj(side,idx).dec_level(idx)
             del self.levels[side][idx]
             
     def on_replace(self,new_oid,orig_oid,venue,side,price,qty):
+        old=self.order_map.pop(orig_oid)     # before the add: new_oid may be orig_oid
         # add first --> get NBBO improvement snapshot if any
         info=self.on_add(new_oid,venue,side,price,qty)
-        self.on_cancel(orig_oid)
-        return info
+        self._remove(*old)
+        if info is None:
+            return None
+        # old_* describe the previous best level as it stands after the replace
+        new_best,new_size,old_price,_,_=info
+        prev_lvl=self.levels[side].get(p2i(old_price))
+        if prev_lvl is None:
+            return new_best,new_size,old_price,0,[]
+        old_venues,_=prev_lvl.snapshot_by_venue()
+        return new_best,new_size,old_price,prev_lvl.agg_qty,old_venues
 
     def on_execute(self, oid, exec_qty):
-        pass
+        """returns (exec_price, level_remaining, per_venue_qty, venues)"""
         side, idx, venue_id, qty_left = self.order_map[oid]
         take = min(exec_qty, qty_left)
         self.order_map[oid] = (side, idx, venue_id, qty_left - take)
@@ -185,11 +195,15 @@ class OrderBook:
         lvl  = self.levels[side][idx]
         dagg = lvl.adjust(venue_id, -take)
 
+        venues,per_venue=lvl.snapshot_by_venue()
+        info=i2p(idx),lvl.agg_qty,list(per_venue),venues
+
         if lvl.agg_qty == 0:
             self._idx_obj(side,idx).dec_level(idx)
             del self.levels[side][idx]
         if (qty_left - take) == 0:
             del self.order_map[oid]
+        return info
     def best_bid(self): 
         s=self.side_idx[b'BID']
         return None if s is None else s.best_price()
@@ -1,58 +1,105 @@
+import numpy as np
 import pyorderbook
 
+_MSG_TYPE = {
+    "add":     pyorderbook.MSG_ADD,
+    "cancel":  pyorderbook.MSG_CANCEL,
+    "replace": pyorderbook.MSG_REPLACE,
+    "execute": pyorderbook.MSG_EXECUTE,
+}
+_SIDE     = {b'BID': pyorderbook.SIDE_BID, b'ASK': pyorderbook.SIDE_ASK}
+_VENUE_ID = {c: i for i, c in enumerate(pyorderbook.VENUE_CODES)}
+_EV_EXEC  = pyorderbook.EV_EXEC
+_NO_TICK  = pyorderbook.NO_TICK
+
 
 class BatchedBookDriver:
     """
-    Batch driver that trusts pyorderbook.OrderBook.on_batch() to return
-    ONLY meaningful payloads (3-tuple for executions, 5-tuple for NBBO
-    improvements).  We publish by inspecting the length.
+    Batch driver over the book's event callback: each flush submits the
+    record buffer, and the book calls _publish with event_dtype arrays
+    (at most callback_batch rows each, kind in event_type) instead of
+    returning a list of payload tuples.
+
+    Events are packed into a preallocated msg_dtype record buffer, so a
+    flush is one GIL-released C++ loop with no per-message tuple casts.
+
+    conflate=True publishes at most one NBBO per side per flush, if its
+    best price or size moved (the final one, old_* = NBBO before the
+    flush, new_price None if the flush emptied the side); executions are
+    unchanged.
     """
 
-    def __init__(self, publisher, batch_size: int = 32):
-        self.book        = pyorderbook.OrderBook()
+    def __init__(self, publisher, batch_size: int = 32,
+                 tick_size: float = pyorderbook.DEFAULT_TICK,
+                 conflate: bool = False, callback_batch: int = 256):
+        self.book        = pyorderbook.OrderBook(tick_size)
+        self.tick        = tick_size
+        self.inv_tick    = 1.0 / tick_size
         self.publisher   = publisher
-        self.batch       = []
+        self.batch       = np.zeros(batch_size, dtype=pyorderbook.msg_dtype)
+        self.n           = 0
         self.batch_size  = batch_size
+        self.conflate    = conflate
+        self.book.set_event_callback(self._publish, callback_batch)
 
     # ---------------- flush ----------------
     def _flush(self):
-        if not self.batch:
+        if not self.n:
             return
+        n, self.n = self.n, 0
+        self.book.submit_array(self.batch[:n], conflate=self.conflate)   # one C++ call
 
-        results = self.book.on_batch(self.batch)  # one C++ call
-        self.batch.clear()
-
-        for res in results:
-            if len(res) == 4:                     # execution payload
-                exec_px, rem, per_venue, venue_str = res
-                self.publisher.publish({
+    def _publish(self, events):
+        tick, publish = self.tick, self.publisher.publish
+        for kind, px, agg, old_px, old_agg, mask, per_venue in events.tolist():
+            if kind == _EV_EXEC:
+                publish({
                     "type":            "execute",
-                    "exec_price":      exec_px,
-                    "total_remaining": rem,
+                    "exec_price":      px * tick,
+                    "total_remaining": agg,
                     "per_venue_qty":   per_venue,
                 })
-            else:                                 # len == 5 → price-improvement
-                new_px, new_sz, old_px, old_sz, venue_str = res
-                self.publisher.publish({
-                    "type":       "add",          # add/replace NBBO jump
-                    "new_price":  new_px,
-                    "new_size":   new_sz,
-                    "old_price":  old_px,
-                    "old_size":   old_sz,
-                    "old_venues": venue_str,
+            else:                                 # EV_NBBO: add/replace NBBO jump
+                publish({
+                    "type":       "add",
+                    "new_price":  None if px == _NO_TICK else px * tick,
+                    "new_size":   agg,
+                    "old_price":  None if old_px == _NO_TICK else old_px * tick,
+                    "old_size":   old_agg,
+                    "old_venues": pyorderbook.venue_string(mask),
                 })
 
+    # ---------------- encode ----------------
+    def _record(self, evt):
+        """tuple event → (msg_type, oid, old_oid, venue, side, price_ticks, qty)"""
+        cmd = evt[0]
+        if cmd == "add":
+            _, oid, venue, side, price, qty = evt
+            return (_MSG_TYPE[cmd], oid, 0, _VENUE_ID[venue], _SIDE[side],
+                    round(price * self.inv_tick), qty)
+        if cmd == "replace":
+            _, new_oid, old_oid, venue, side, price, qty = evt
+            return (_MSG_TYPE[cmd], new_oid, old_oid, _VENUE_ID[venue],
+                    _SIDE[side], round(price * self.inv_tick), qty)
+        if cmd == "execute":
+            _, oid, exec_qty = evt
+            return (_MSG_TYPE[cmd], oid, 0, 0, 0, 0, exec_qty)
+        if cmd == "cancel":
+            return (_MSG_TYPE[cmd], evt[1], 0, 0, 0, 0, 0)
+        raise ValueError(f"Bad cmd {cmd!r}")
+
     # ---------------- public API ----------------
     def on_event(self, evt):
         """
-        evt one of:
+        evt one of (oids are 64-bit ints, venue is a one-letter code):
           ("add",     oid, venue, side, price,   qty)
           ("cancel",  oid)
           ("replace", new_oid, old_oid, venue, side, price, qty)
           ("execute", oid, exec_qty)
         """
-        self.batch.append(evt)
-        if len(self.batch) >= self.batch_size:
+        self.batch[self.n] = self._record(evt)
+        self.n += 1
+        if self.n >= self.batch_size:
             self._flush()
 
     def close(self):
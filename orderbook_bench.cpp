@@ -0,0 +1,386 @@
+/*
+ * Google Benchmark suite for the native book.
+ *
+ *   g++ -std=c++17 -O2 -DNDEBUG orderbook_bench.cpp -lbenchmark -lpthread -o orderbook_bench
+ *   ./orderbook_bench [workload flags] [--benchmark_* flags]
+ *
+ * Add -march=native (or -mavx2 / -mavx512f) to build the SIMD venue-lane
+ * kernels instead of the scalar ones.  Build with -std=c++20 to add the
+ * coroutine Pipeline benchmarks.  Correctness lives in the test
+ * executables (orderbook_core_test.cpp, pipeline_test.cpp); this suite
+ * only times.
+ *
+ * Workload flags (defaults model an options feed):
+ *   --mix=A,X,R,E      add / cancel / replace / execute weights   (35,25,30,10)
+ *   --spread=N         ticks either side of the touch            (40)
+ *   --per_level=N      target resting orders per level           (4)
+ *   --venues=N         venues in use, 1..14                      (14)
+ *   --messages=N       messages per generated stream             (1<<18)
+ *   --capture=PATH     also benchmark a wire-format capture file
+ *
+ * Throughput benchmarks report s/msg (printed as e.g. 38.3n); the *Latency ones time every
+ * message with cycles() and report p50/p99/p999 in ns.
+ */
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <random>
+#include <string>
+#include "orderbook_core.hpp"
+#include "feed_decoder.hpp"
+#include "replay.hpp"
+#include "snapshot.hpp"
+#if __cplusplus >= 202002L
+#include "pipeline.hpp"
+#endif
+
+/* ---------- workload ---------- */
+struct Workload {
+    unsigned mix[4]   = {35, 25, 30, 10};     /* A X R E */
+    int      spread    = 40;
+    int      per_level = 4;
+    int      venues    = NUM_VENUES;
+    size_t   messages  = size_t(1)<<18;
+    std::string capture;
+};
+
+/*
+ * Self-consistent message stream starting from an empty book: cancels,
+ * replaces and executes only name live orders, and adds are favoured
+ * while the book holds fewer than 2*spread*per_level orders.
+ */
+static std::vector<MsgRecord> generate(const Workload& w, uint32_t seed = 1){
+    struct Live { uint64_t oid; uint32_t qty; };
+    std::mt19937_64 rng(seed);
+    std::vector<MsgRecord> out;
+    std::vector<Live> live;
+    out.reserve(w.messages);
+    uint64_t next = 1;
+    const int mid = 100000;
+    const size_t target = size_t(2*w.spread*w.per_level);
+    unsigned total = w.mix[0]+w.mix[1]+w.mix[2]+w.mix[3];
+
+    auto quote = [&](MsgRecord& r){
+        bool bid = rng() & 1;
+        int  off = int(rng() % unsigned(w.spread));
+        r.side        = uint8_t(bid ? Side::Bid : Side::Ask);
+        r.price_ticks = bid ? mid-1-off : mid+1+off;
+        r.venue       = uint8_t(rng() % unsigned(w.venues));
+        r.qty         = 1 + uint32_t(rng() % 50);
+    };
+
+    while(out.size() < w.messages){
+        unsigned pick = unsigned(rng() % total);
+        int kind = pick < w.mix[0] ? 0 : pick < w.mix[0]+w.mix[1] ? 1
+                 : pick < w.mix[0]+w.mix[1]+w.mix[2] ? 2 : 3;
+        if(live.empty() || (kind!=0 && live.size() < target/2 && rng()%2)) kind = 0;
+
+        MsgRecord r{};
+        if(kind==0){
+            r.msg_type = MSG_ADD;
+            r.oid = next++;
+            quote(r);
+            live.push_back({r.oid, r.qty});
+        }else{
+            size_t k = rng() % live.size();
+            Live& o = live[k];
+            if(kind==1){
+                r.msg_type = MSG_CANCEL;
+                r.oid = o.oid;
+                o = live.back(); live.pop_back();
+            }else if(kind==2){
+                r.msg_type = MSG_REPLACE;
+                r.old_oid = o.oid;
+                r.oid = next++;
+                quote(r);
+                o = {r.oid, r.qty};
+            }else{
+                r.msg_type = MSG_EXECUTE;
+                r.oid = o.oid;
+                r.qty = 1 + uint32_t(rng() % o.qty);
+                if((o.qty -= r.qty) == 0){ o = live.back(); live.pop_back(); }
+            }
+        }
+        out.push_back(r);
+    }
+    return out;
+}
+
+struct CountSink {
+    size_t n{0};
+    void push_back(const BookEvent&){ ++n; }
+};
+
+static void report_ns_per_msg(benchmark::State& st, size_t per_iter){
+    st.SetItemsProcessed(int64_t(st.iterations() * per_iter));
+    /* seconds per message; the console prints it with an SI prefix (38.3n) */
+    st.counters["s/msg"] = benchmark::Counter(double(per_iter),
+                                              benchmark::Counter::kIsIterationInvariantRate |
+                                              benchmark::Counter::kInvert);
+}
+
+static void report_quantiles(benchmark::State& st, const LogHistogram& h){
+    double cpn = cycles_per_ns();
+    st.counters["p50_ns"]  = double(h.quantile(0.50))  / cpn;
+    st.counters["p99_ns"]  = double(h.quantile(0.99))  / cpn;
+    st.counters["p999_ns"] = double(h.quantile(0.999)) / cpn;
+}
+
+/* ---------- SideBook ---------- */
+static void BM_SideBookAddRemove(benchmark::State& st, Workload w){
+    std::mt19937 rng(7);
+    std::vector<std::pair<int,uint8_t>> ops(size_t(1)<<16);
+    for(auto& op : ops) op = {100000 - int(rng() % unsigned(w.spread)), uint8_t(rng() % unsigned(w.venues))};
+    BidBook sb;
+    for(auto _ : st){
+        for(auto& [idx,v] : ops) benchmark::DoNotOptimize(sb.add(idx, v, 1));
+        for(auto& [idx,v] : ops) sb.remove(idx, v, 1);
+    }
+    report_ns_per_msg(st, 2*ops.size());
+}
+
+/* depth_within / fill on a side holding spread ticks of per_level orders */
+static void BM_SideBookAggregates(benchmark::State& st, Workload w){
+    std::mt19937 rng(9);
+    BidBook sb;
+    for(int i=0;i<w.spread*w.per_level;++i)
+        sb.add(100000 - int(rng() % unsigned(w.spread)), uint8_t(rng() % unsigned(w.venues)), 1 + rng() % 50);
+    uint64_t half = sb.total_qty() / 2;
+    for(auto _ : st){
+        benchmark::DoNotOptimize(sb.depth_within(w.spread/2));
+        benchmark::DoNotOptimize(sb.fill(half));
+    }
+    report_ns_per_msg(st, 2);
+}
+
+/* ---------- OrderMap ---------- */
+static void BM_OrderMapChurn(benchmark::State& st, Workload w){
+    size_t resting = size_t(2*w.spread*w.per_level);
+    OrderMap map;
+    uint64_t next = 1;
+    for(; next <= resting; ++next) map.insert(next, Meta{0,1,0,Side::Bid});
+    for(auto _ : st){
+        for(int i=0;i<4096;++i){
+            map.insert(next, Meta{0,1,0,Side::Bid});
+            benchmark::DoNotOptimize(map.find(next - resting/2));
+            map.erase(next - resting);
+            ++next;
+        }
+    }
+    report_ns_per_msg(st, 3*4096);
+}
+
+/* ---------- full apply loop ---------- */
+template<class Book>
+static void BM_Apply(benchmark::State& st, std::vector<MsgRecord> recs){
+    Book book;
+    CountSink sink;
+    for(auto _ : st){
+        st.PauseTiming();
+        book.reset();
+        st.ResumeTiming();
+        book.apply(recs.data(), recs.size(), sink);
+    }
+    benchmark::DoNotOptimize(sink.n);
+    report_ns_per_msg(st, recs.size());
+}
+
+static void BM_ApplyLatency(benchmark::State& st, std::vector<MsgRecord> recs){
+    OrderBookCore book;
+    CountSink sink;
+    LogHistogram h;
+    for(auto _ : st){
+        st.PauseTiming();
+        book.reset();
+        st.ResumeTiming();
+        for(const auto& r : recs){
+            uint64_t t0 = cycles();
+            book.apply_one(r, sink);
+            h.record(cycles() - t0);
+        }
+    }
+    report_ns_per_msg(st, recs.size());
+    report_quantiles(st, h);
+}
+
+/* ---------- venue halt: one bulk call vs a cancel per order ---------- */
+template<bool Bulk>
+static void BM_VenueHalt(benchmark::State& st, std::vector<MsgRecord> recs){
+    OrderBookCore book;
+    CountSink sink;
+    std::vector<uint64_t> victims;
+    for(const auto& r : recs) if(r.msg_type==MSG_ADD && r.venue==0) victims.push_back(uint64_t(r.oid));
+    for(auto _ : st){
+        st.PauseTiming();
+        book.reset();
+        book.apply(recs.data(), recs.size(), sink);
+        st.ResumeTiming();
+        if constexpr (Bulk) book.cancel_venue(Venue(0), sink);
+        else for(uint64_t oid : victims) book.cancel(oid);
+    }
+    benchmark::DoNotOptimize(sink.n);
+    report_ns_per_msg(st, victims.size());
+}
+
+/* halting an idle venue: the generation bump, plus a sweep every 65536
+   (orderbook_core_test checks what a halt leaves behind)             */
+template<class Book>
+static void BM_HaltIdleVenue(benchmark::State& st){
+    Book book;
+    CountSink sink;
+    for(auto _ : st) book.cancel_venue(Venue(0), sink);
+    report_ns_per_msg(st, 1);
+}
+
+/* ---------- snapshot round trip ---------- */
+/* restore + re-serialize a book saved half way through the stream, just
+   after a venue halt (orderbook_core_test checks the result)          */
+template<class Book>
+static void BM_SnapshotRoundTrip(benchmark::State& st, std::vector<MsgRecord> recs){
+    const size_t cut = recs.size()/2;
+    Book book, restored;
+    CountSink sink;
+    book.apply(recs.data(), cut, sink);
+    book.cancel_venue(Venue(3), sink);
+    std::vector<uint8_t> saved, again;
+    serialize(saved, book, cut);
+    for(auto _ : st){
+        SnapshotReader rd(saved.data(), saved.size());
+        rd.next(restored);
+        serialize(again, restored, rd.seq());
+    }
+    benchmark::DoNotOptimize(again.data());
+    st.SetBytesProcessed(int64_t(st.iterations() * saved.size()));
+}
+
+/* ---------- wire decode + apply ---------- */
+static void BM_Decode(benchmark::State& st, std::vector<uint8_t> wire_buf, size_t msgs){
+    OrderBookCore book;
+    CountSink sink;
+    for(auto _ : st){
+        st.PauseTiming();
+        book.reset();
+        st.ResumeTiming();
+        wire::decode(wire_buf.data(), wire_buf.size(), book, sink);
+    }
+    report_ns_per_msg(st, msgs);
+}
+
+static std::vector<uint8_t> encode_all(const std::vector<MsgRecord>& recs){
+    std::vector<uint8_t> buf(recs.size() * wire::MAX_MSG);
+    size_t len = 0;
+    for(const auto& r : recs) len += wire::encode(r, &buf[len]);
+    buf.resize(len);
+    return buf;
+}
+
+/* capture file → records, via the mmap reader */
+static std::vector<MsgRecord> load_capture(const std::string& path){
+    MappedFile f(path);
+    std::vector<MsgRecord> recs;
+    for(size_t off = 0; off < f.size(); ){
+        size_t n = wire::SIZES.len[f.data()[off]];
+        if(!n || off+n > f.size()) throw std::runtime_error("bad capture at offset " + std::to_string(off));
+        recs.push_back(wire::parse(f.data()+off));
+        off += n;
+    }
+    return recs;
+}
+
+#if __cplusplus >= 202002L
+/* ---------- coroutine pipeline (C++20 builds only) ---------- */
+/* the stream read max_read bytes at a time through Pipeline; small reads
+   split most messages across receive buffers (pipeline_test checks the
+   events and the adaptive batch target)                                 */
+static void BM_Pipeline(benchmark::State& st, std::vector<MsgRecord> recs, size_t max_read,
+                        pipeline::PipelineConfig cfg){
+    std::vector<uint8_t> wire_buf = encode_all(recs);
+    OrderBookCore book;
+    CountSink sink;
+    pipeline::PipelineStats ps;
+    for(auto _ : st){
+        st.PauseTiming();
+        book.reset();
+        st.ResumeTiming();
+        pipeline::MemorySource src(wire_buf.data(), wire_buf.size(), max_read);
+        pipeline::Pipeline pipe(book, src, sink, cfg);
+        ps = pipe.run();
+    }
+    benchmark::DoNotOptimize(sink.n);
+    st.counters["mean_batch"]   = ps.mean_batch();
+    st.counters["batch_target"] = double(ps.batch_target);
+    report_ns_per_msg(st, recs.size());
+}
+#endif
+
+/* ---------- flags ---------- */
+static bool take_flag(const char* arg, const char* name, std::string& val){
+    size_t n = std::strlen(name);
+    if(std::strncmp(arg, name, n) || arg[n] != '=') return false;
+    val = arg + n + 1;
+    return true;
+}
+
+static Workload parse_flags(int& argc, char** argv){
+    Workload w;
+    int kept = 1;
+    for(int i=1;i<argc;++i){
+        std::string v;
+        if(take_flag(argv[i], "--mix", v)){
+            if(std::sscanf(v.c_str(), "%u,%u,%u,%u", &w.mix[0], &w.mix[1], &w.mix[2], &w.mix[3]) != 4)
+                throw std::invalid_argument("--mix wants A,X,R,E");
+        }
+        else if(take_flag(argv[i], "--spread", v))    w.spread    = std::max(1, std::stoi(v));
+        else if(take_flag(argv[i], "--per_level", v)) w.per_level = std::max(1, std::stoi(v));
+        else if(take_flag(argv[i], "--venues", v))    w.venues    = std::clamp(std::stoi(v), 1, int(NUM_VENUES));
+        else if(take_flag(argv[i], "--messages", v))  w.messages  = std::stoull(v);
+        else if(take_flag(argv[i], "--capture", v))   w.capture   = v;
+        else argv[kept++] = argv[i];
+    }
+    argc = kept;
+    return w;
+}
+
+int main(int argc, char** argv){
+    Workload w = parse_flags(argc, argv);
+    benchmark::Initialize(&argc, argv);
+
+    std::vector<MsgRecord> synth = generate(w);
+    Workload adds_only = w;
+    adds_only.mix[1] = adds_only.mix[2] = adds_only.mix[3] = 0;
+    adds_only.messages = std::min<size_t>(w.messages, 1<<16);
+
+    benchmark::RegisterBenchmark("SideBook/add_remove", BM_SideBookAddRemove, w);
+    benchmark::RegisterBenchmark("SideBook/aggregates", BM_SideBookAggregates, w);
+    benchmark::RegisterBenchmark("OrderMap/churn", BM_OrderMapChurn, w);
+    benchmark::RegisterBenchmark("Apply/synthetic", BM_Apply<OrderBookCore>, synth);
+    benchmark::RegisterBenchmark("Apply/synthetic_l3", BM_Apply<L3OrderBookCore>, synth);
+    benchmark::RegisterBenchmark("Apply/adds_only", BM_Apply<OrderBookCore>, generate(adds_only));
+    benchmark::RegisterBenchmark("ApplyLatency/synthetic", BM_ApplyLatency, synth);
+    benchmark::RegisterBenchmark("Decode/synthetic", BM_Decode, encode_all(synth), synth.size());
+    /* setup rebuilds the whole book, so cap the iterations */
+    benchmark::RegisterBenchmark("VenueHalt/bulk", BM_VenueHalt<true>, generate(adds_only))->Iterations(200);
+    benchmark::RegisterBenchmark("VenueHalt/cancels", BM_VenueHalt<false>, generate(adds_only))->Iterations(200);
+    benchmark::RegisterBenchmark("VenueHalt/idle_venue", BM_HaltIdleVenue<OrderBookCore>);
+    benchmark::RegisterBenchmark("VenueHalt/idle_venue_l3", BM_HaltIdleVenue<L3OrderBookCore>);
+
+    benchmark::RegisterBenchmark("Snapshot/round_trip", BM_SnapshotRoundTrip<OrderBookCore>, synth);
+    benchmark::RegisterBenchmark("Snapshot/round_trip_l3", BM_SnapshotRoundTrip<L3OrderBookCore>, synth);
+
+#if __cplusplus >= 202002L
+    pipeline::PipelineConfig pcfg;
+    benchmark::RegisterBenchmark("Pipeline/split_reads", BM_Pipeline, synth, size_t(7), pcfg);
+    benchmark::RegisterBenchmark("Pipeline/one_byte_reads", BM_Pipeline, synth, size_t(1), pcfg);
+    benchmark::RegisterBenchmark("Pipeline/backlog", BM_Pipeline, synth, pcfg.recv_bytes, pcfg);
+#endif
+
+    if(!w.capture.empty()){
+        std::vector<MsgRecord> cap = load_capture(w.capture);
+        benchmark::RegisterBenchmark("Apply/capture", BM_Apply<OrderBookCore>, cap);
+        benchmark::RegisterBenchmark("ApplyLatency/capture", BM_ApplyLatency, cap);
+        benchmark::RegisterBenchmark("Decode/capture", BM_Decode, encode_all(cap), cap.size());
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
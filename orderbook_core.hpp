@@ -0,0 +1,1874 @@
+#pragma once
+/*
+ * Pure C++ order book core: price levels, side books, order maps and
+ * OrderBookCore.  No pybind11 here -- the Python module in orderbook.cpp
+ * is a thin adapter over these types.
+ */
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <limits>
+#include <type_traits>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "node_pool.hpp"
+#include "book_stats.hpp"
+
+/* ---------- constants / helpers ---------- */
+constexpr double DEFAULT_TICK = 0.01;
+constexpr size_t NUM_VENUES = 14;
+constexpr int    WINDOW = 1024;          /* dense ticks per side (±$5.12) */
+constexpr int    HALF_W = WINDOW / 2;
+constexpr size_t BITMAP_WORDS = WINDOW / 64;
+
+enum class Side : uint8_t { Bid = 0, Ask = 1 };
+
+enum class Venue : uint8_t {
+    CBOE, ISE, BOX, MIAX, ARCA, PHLX, GEM, EDGX,
+    BAT, MRX, BZX, NDQ, C2, AMEX
+};
+
+inline constexpr std::array<std::string_view,NUM_VENUES> VENUES = {
+    "CBOE","ISE","BOX","MIAX","ARCA","PHLX","GEM","EDGX",
+    "BAT","MRX","BZX","NDQ","C2","AMEX"
+};
+inline const std::unordered_map<std::string_view,size_t> VENUE_MAP = {
+    {"CBOE",0},{"ISE",1},{"BOX",2},{"MIAX",3},{"ARCA",4},
+    {"PHLX",5},{"GEM",6},{"EDGX",7},{"BAT",8},{"MRX",9},
+    {"BZX",10},{"NDQ",11},{"C2",12},{"AMEX",13}
+};
+/* one-letter feed code per venue, same order as VENUES */
+inline constexpr std::array<char,NUM_VENUES> VENUE_CODE = {
+    'C','I','B','M','N','X','H','E',
+    'Y','J','Z','Q','W','A'
+};
+
+inline Venue venue_of(char code){
+    for(size_t i=0;i<NUM_VENUES;++i)
+        if(VENUE_CODE[i]==code) return Venue(i);
+    throw std::out_of_range(std::string("unknown venue code ")+code);
+}
+
+/* ---------- TickScale ---------- */
+/*
+ * The book only ever sees integer ticks.  TickScale is the per-instrument
+ * price grid used at the edges (double entry points and double output
+ * columns), so nickel and sub-penny classes convert exactly.
+ */
+constexpr int32_t NO_TICK = std::numeric_limits<int32_t>::min();
+
+struct TickScale {
+    double tick{DEFAULT_TICK};
+    double inv{1/DEFAULT_TICK};
+
+    TickScale() = default;
+    explicit TickScale(double t) : tick(t), inv(1/t) {
+        if(!(t > 0)) throw std::invalid_argument("tick size must be positive");
+    }
+    int32_t to_ticks(double p) const { return int32_t(std::lround(p*inv)); }
+    double  to_price(int32_t t) const { return t*tick; }
+};
+
+/* ---------- venue lanes ---------- */
+/*
+ * Per-venue quantities are padded to VENUE_LANES u32 lanes, one cache
+ * line, with the pad lanes always zero, so a whole row is one 512-bit or
+ * two 256-bit registers.  The kernels below pick AVX-512 or AVX2 at
+ * compile time (-mavx512f / -mavx2 / -march=native) and fall back to
+ * plain loops otherwise; VENUE_SIMD names the one built in.
+ */
+constexpr size_t VENUE_LANES = 16;
+static_assert(NUM_VENUES <= VENUE_LANES, "venues must fit the padded row");
+using VenueQty = std::array<uint32_t,VENUE_LANES>;
+
+#if defined(__AVX512F__)
+constexpr const char* VENUE_SIMD = "avx512";
+#elif defined(__AVX2__)
+constexpr const char* VENUE_SIMD = "avx2";
+#else
+constexpr const char* VENUE_SIMD = "scalar";
+#endif
+
+namespace lanes {
+
+/* bit i set iff q[i] != 0 */
+inline uint16_t nonzero_mask(const VenueQty& q){
+#if defined(__AVX512F__)
+    __m512i v = _mm512_loadu_si512(q.data());
+    return uint16_t(_mm512_test_epi32_mask(v, v));
+#elif defined(__AVX2__)
+    __m256i z  = _mm256_setzero_si256();
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q.data()));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q.data()+8));
+    unsigned zl = unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(lo, z))));
+    unsigned zh = unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(hi, z))));
+    return uint16_t(~(zl | zh<<8));
+#else
+    unsigned m = 0;
+    for(size_t i=0;i<VENUE_LANES;++i) m |= unsigned(q[i]!=0) << i;
+    return uint16_t(m);
+#endif
+}
+
+/* sum over all lanes (two 256-bit halves on AVX-512 builds too) */
+inline uint32_t sum(const VenueQty& q){
+#if defined(__AVX2__)
+    __m256i v = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(q.data())),
+                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q.data()+8)));
+    __m128i x = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1,0,3,2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2,3,0,1)));
+    return uint32_t(_mm_cvtsi128_si32(x));
+#else
+    uint32_t s = 0;
+    for(auto v : q) s += v;
+    return s;
+#endif
+}
+
+/* the NUM_VENUES real lanes → out (any alignment; nothing past them written) */
+inline void copy_out(const VenueQty& q,uint32_t* out){
+#if defined(__AVX512F__)
+    _mm512_mask_storeu_epi32(out, __mmask16((1u<<NUM_VENUES)-1), _mm512_loadu_si512(q.data()));
+#elif defined(__AVX2__)
+    static_assert(NUM_VENUES > 8, "two-register copy");
+    const __m256i keep = _mm256_setr_epi32(8<NUM_VENUES ? -1 : 0,  9<NUM_VENUES ? -1 : 0,
+                                           10<NUM_VENUES ? -1 : 0, 11<NUM_VENUES ? -1 : 0,
+                                           12<NUM_VENUES ? -1 : 0, 13<NUM_VENUES ? -1 : 0,
+                                           14<NUM_VENUES ? -1 : 0, 15<NUM_VENUES ? -1 : 0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q.data())));
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(out+8), keep,
+                           _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q.data()+8)));
+#else
+    std::copy(q.begin(), q.begin()+NUM_VENUES, out);
+#endif
+}
+
+/* NUM_VENUES quantities from in → q, pad lanes zeroed */
+inline void copy_in(const uint32_t* in,VenueQty& q){
+    q = VenueQty{};
+    std::copy(in, in+NUM_VENUES, q.begin());
+}
+
+} // namespace lanes
+
+/* ---------- PriceLevel ---------- */
+/* one level; vqty fills the first cache line, agg and mask follow */
+struct alignas(64) PriceLevel {
+    VenueQty vqty{};                  /* lanes >= NUM_VENUES stay 0 */
+    uint32_t agg{0};
+    uint16_t mask{0};                 /* bit i set iff vqty[i] != 0 */
+    void adjust(size_t vid,int d){
+        vqty[vid]+=d; agg+=d;
+        uint16_t bit = uint16_t(1u<<vid);
+        mask = uint16_t((mask & ~bit) | (vqty[vid] ? bit : 0));
+    }
+    /* zero venue vid's lane; returns the qty it held */
+    uint32_t clear_venue(size_t vid){
+        uint32_t q = vqty[vid];
+        vqty[vid] = 0; agg -= q;
+        mask = uint16_t(mask & ~(1u<<vid));
+        return q;
+    }
+    /* agg and mask from vqty (after bulk edits or a restore) */
+    void recompute(){
+        agg  = lanes::sum(vqty);
+        mask = lanes::nonzero_mask(vqty);
+    }
+};
+
+/* ---------- venue strings ---------- */
+/*
+ * Alphabetical concatenation of VENUE_CODE letters for every possible
+ * venue mask, built once, so the top-of-book path never sorts.
+ */
+class VenueStringTable {
+    struct Entry{ char s[NUM_VENUES]; uint8_t len; };
+    std::vector<Entry> table_;
+public:
+    VenueStringTable(): table_(size_t(1)<<NUM_VENUES) {
+        std::array<size_t,NUM_VENUES> order;  /* venue ids by code letter */
+        for(size_t i=0;i<NUM_VENUES;++i) order[i]=i;
+        std::sort(order.begin(), order.end(),
+                  [](size_t a,size_t b){ return VENUE_CODE[a]<VENUE_CODE[b]; });
+        for(size_t m=0;m<table_.size();++m){
+            Entry& e = table_[m];
+            e.len = 0;
+            for(size_t vid : order)
+                if(m>>vid & 1) e.s[e.len++] = VENUE_CODE[vid];
+        }
+    }
+    std::string_view operator[](uint16_t mask) const {
+        const Entry& e = table_[mask];
+        return {e.s, e.len};
+    }
+};
+
+inline std::string_view venue_string(uint16_t mask){
+    static const VenueStringTable table;
+    return table[mask];
+}
+
+/* ---------- fixed-width batch records ---------- */
+enum MsgType : uint8_t {
+    MSG_ADD = 'A', MSG_CANCEL = 'X', MSG_REPLACE = 'R', MSG_EXECUTE = 'E'
+};
+
+/* one message; layout matches msg_dtype (packed, little-endian) */
+#pragma pack(push,1)
+struct MsgRecord {
+    uint8_t  msg_type;      /* MsgType                          */
+    uint64_t oid;           /* new oid for replace              */
+    uint64_t old_oid;       /* replace only                     */
+    uint8_t  venue;         /* index into VENUES                */
+    uint8_t  side;          /* Side                             */
+    int32_t  price_ticks;   /* price in the instrument's ticks  */
+    uint32_t qty;           /* add/replace qty or exec qty      */
+};
+#pragma pack(pop)
+static_assert(sizeof(MsgRecord) == 27, "MsgRecord must stay packed");
+
+/* ---------- BookEvent  (result of one message, no Python types) ---------- */
+enum EventType : uint8_t { EV_NBBO = 1, EV_EXEC = 2 };
+struct BookEvent {
+    uint8_t  type;
+    int      idx;           /* new best tick / exec tick        */
+    uint32_t agg;           /* new best size / remaining at exec*/
+    int      old_idx;       /* NBBO only                        */
+    uint32_t old_agg;       /* NBBO only                        */
+    uint16_t vmask;         /* PriceLevel::mask of that level   */
+    VenueQty vqty;          /* old best level / exec level      */
+};
+
+/* event sink writing straight into caller-owned columns (one row per event).
+   Price is double (converted with scale, NaN for "none") or int32_t ticks
+   (copied as is, NO_TICK for "none").                                    */
+template<class Price>
+struct BasicColumnSink {
+    uint8_t*  type;
+    Price*    price;
+    uint32_t* agg;
+    Price*    old_price;
+    uint32_t* old_agg;
+    uint16_t* vmask;
+    uint32_t* vqty;         /* row-major [rows][NUM_VENUES] */
+    size_t    n{0};
+    TickScale scale{};
+
+    Price out(int t) const {
+        if constexpr (std::is_floating_point<Price>::value)
+            return t==NO_TICK ? none() : scale.to_price(t);
+        else return Price(t);
+    }
+    static Price none(){
+        if constexpr (std::is_floating_point<Price>::value) return NAN;
+        else return NO_TICK;
+    }
+    void push_back(const BookEvent& ev){
+        type[n]      = ev.type;
+        price[n]     = out(ev.idx);
+        agg[n]       = ev.agg;
+        old_price[n] = ev.type==EV_NBBO ? out(ev.old_idx) : none();
+        old_agg[n]   = ev.old_agg;
+        vmask[n]     = ev.vmask;
+        lanes::copy_out(ev.vqty, vqty + n*NUM_VENUES);
+        ++n;
+    }
+};
+using ColumnSink     = BasicColumnSink<double>;
+using TickColumnSink = BasicColumnSink<int32_t>;
+
+/* ---------- OccupancyBitmap ---------- */
+/*
+ * Two-level bitmap over the dense window: one bit per tick in words_,
+ * plus a summary word with bit w set iff words_[w] != 0.  Any "next live
+ * tick" query is one ctz/clz on the summary and one on the word, so the
+ * cost does not depend on how sparse the window is.
+ */
+struct OccupancyBitmap {
+    static_assert(BITMAP_WORDS <= 64, "summary word covers 64 words");
+    static constexpr int NONE = -1;
+
+    std::array<uint64_t,BITMAP_WORDS> words_{};
+    uint64_t summary_{0};
+
+    void set(int rel){
+        int w = rel>>6;
+        words_[w] |= uint64_t(1)<<(rel&63);
+        summary_  |= uint64_t(1)<<w;
+    }
+    void clear(int rel){
+        int w = rel>>6;
+        words_[w] &= ~(uint64_t(1)<<(rel&63));
+        if(!words_[w]) summary_ &= ~(uint64_t(1)<<w);
+    }
+    bool test(int rel) const { return words_[rel>>6]>>(rel&63) & 1; }
+    bool empty() const { return summary_==0; }
+
+    int highest() const {
+        if(!summary_) return NONE;
+        int w = 63-__builtin_clzll(summary_);
+        return w*64 + 63-__builtin_clzll(words_[w]);
+    }
+    int lowest() const {
+        if(!summary_) return NONE;
+        int w = __builtin_ctzll(summary_);
+        return w*64 + __builtin_ctzll(words_[w]);
+    }
+    /* highest live rel strictly below rel, or NONE */
+    int next_below(int rel) const {
+        int w = rel>>6, b = rel&63;
+        uint64_t m = words_[w] & ((uint64_t(1)<<b)-1);
+        if(m) return w*64 + 63-__builtin_clzll(m);
+        uint64_t s = summary_ & ((uint64_t(1)<<w)-1);
+        if(!s) return NONE;
+        w = 63-__builtin_clzll(s);
+        return w*64 + 63-__builtin_clzll(words_[w]);
+    }
+    /* lowest live rel strictly above rel, or NONE */
+    int next_above(int rel) const {
+        int w = rel>>6, b = rel&63;
+        uint64_t m = b==63 ? 0 : words_[w] & ~((uint64_t(2)<<b)-1);
+        if(m) return w*64 + __builtin_ctzll(m);
+        uint64_t s = w==63 ? 0 : summary_ & ~((uint64_t(2)<<w)-1);
+        if(!s) return NONE;
+        w = __builtin_ctzll(s);
+        return w*64 + __builtin_ctzll(words_[w]);
+    }
+};
+
+/* ---------- WindowSums ---------- */
+/*
+ * qty and qty*rel summed per OccupancyBitmap word (64 ticks), kept as
+ * levels change.  A window range or a walk from the touch then costs at
+ * most BITMAP_WORDS word sums plus the live levels of the partial words
+ * at its ends, found through the bitmap; an update is a single add.
+ */
+struct WindowSums {
+    struct Sum { int64_t qty{0}; int64_t rel_qty{0}; };   /* rel_qty: sum of qty*rel */
+    std::array<Sum,BITMAP_WORDS> w{};
+
+    void add(int rel,int64_t d){
+        Sum& s = w[size_t(rel>>6)];
+        s.qty += d; s.rel_qty += d*rel;
+    }
+    void clear(){ w.fill(Sum{}); }
+    /* bits lo..hi of a word */
+    static uint64_t bits(int lo,int hi){
+        return (hi==63 ? ~uint64_t(0) : (uint64_t(2)<<hi)-1) & ~((uint64_t(1)<<lo)-1);
+    }
+};
+
+/* result of walking a side from the touch: VWAP = notional / qty ticks */
+struct FillEstimate {
+    uint64_t qty{0};                /* filled, < asked if the side ran out */
+    int64_t  notional{0};           /* sum of qty * price_ticks             */
+    int      worst{NO_TICK};        /* last price touched                   */
+};
+
+/* ---------- SideBook  (dense window + sparse fallback) ---------- */
+/*
+ * Same layout as DenseWindowSide in orderbook.py: a contiguous array of
+ * WINDOW levels centred on the first price seen, an OccupancyBitmap over
+ * that array and a cached best cursor.  Prices that land outside the
+ * window go to a sorted sparse map, which is rarely touched for options.
+ * If the best ends up outside the window while the window holds no live
+ * level, the window is re-centred on the best and the sparse levels it
+ * now covers move into it, so a drifting instrument does not stay on
+ * the map for the rest of the session.
+ * The side is a template parameter, so comparisons, sentinels and the
+ * best-of-bitmap choice are resolved at compile time.  Total qty, level
+ * count and WindowSums are kept as levels change, so depth within N
+ * ticks and the cost of filling Q are answered natively per 64-tick word
+ * rather than by walking every level.
+ */
+template<Side S>
+class SideBook {
+public:
+    static constexpr Side SIDE   = S;
+    static constexpr bool IS_BID = S==Side::Bid;
+    static constexpr int  EMPTY  = IS_BID ? std::numeric_limits<int>::min()
+                                          : std::numeric_limits<int>::max();
+    static constexpr bool better(int a,int b){ return IS_BID ? a>b : a<b; }
+
+private:
+    bool anchored_{false};
+    int  win0_{0};                              /* tick of window_[0]     */
+    int  best_;                                 /* cached best cursor     */
+    std::vector<PriceLevel> window_;            /* WINDOW dense buckets   */
+    OccupancyBitmap occ_;                       /* 1 bit per live tick    */
+    NodePool pool_;                             /* sparse_ nodes          */
+    using SparseAlloc = PoolAllocator<std::pair<const int,PriceLevel>>;
+    std::map<int,PriceLevel,std::less<int>,SparseAlloc> sparse_;  /* out-of-window ticks */
+    WindowSums sums_;                           /* per bitmap word        */
+    uint64_t total_qty_{0};
+    size_t   levels_{0};
+#ifdef ORDERBOOK_STATS
+    LevelCounters ctr_;
+#endif
+
+    void account(bool dense,int rel,int64_t d){
+        total_qty_ += uint64_t(d);
+        if(dense) sums_.add(rel, d);
+    }
+    /* qty of live window levels with rel in [a, b] */
+    uint64_t window_qty(int a,int b) const {
+        uint64_t q = 0;
+        auto part = [&](int w,int lo,int hi){
+            for(uint64_t m = occ_.words_[w] & WindowSums::bits(lo&63, hi&63); m; m &= m-1)
+                q += window_[w*64 + __builtin_ctzll(m)].agg;
+        };
+        int wa = a>>6, wb = b>>6;
+        if(wa==wb){ part(wa, a, b); return q; }
+        part(wa, a, wa*64+63);
+        for(int w=wa+1; w<wb; ++w) q += uint64_t(sums_.w[w].qty);
+        part(wb, wb*64, b);
+        return q;
+    }
+
+    bool in_window(int idx) const {
+        return anchored_ && unsigned(idx-win0_) < unsigned(WINDOW);
+    }
+    /* best live tick inside the window, or EMPTY */
+    int best_in_window() const {
+        int rel;
+        if constexpr (IS_BID) rel = occ_.highest();
+        else                  rel = occ_.lowest();
+        return rel==OccupancyBitmap::NONE ? EMPTY : win0_+rel;
+    }
+    int best_in_sparse() const {
+        if(sparse_.empty()) return EMPTY;
+        if constexpr (IS_BID) return sparse_.rbegin()->first;
+        else                  return sparse_.begin()->first;
+    }
+    int rescan() const {
+        int w = best_in_window(), s = best_in_sparse();
+        return better(s,w) ? s : w;
+    }
+    /* an empty window the best has left: centre it on the best and pull
+       in the sparse levels that fall inside it                         */
+    void follow_best(){
+        if(!occ_.empty() || best_==EMPTY || in_window(best_)) return;
+        win0_ = best_-HALF_W;
+        for(auto it = sparse_.lower_bound(win0_); it != sparse_.end() && it->first-win0_ < WINDOW;
+            it = sparse_.erase(it)){
+            int rel = it->first-win0_;
+            window_[rel] = it->second;
+            occ_.set(rel);
+            sums_.add(rel, int64_t(it->second.agg));
+        }
+        OB_STAT(++ctr_.recentres);
+    }
+
+public:
+    SideBook()
+        : best_(EMPTY), window_(WINDOW),
+          pool_(64), sparse_(std::less<int>(), SparseAlloc(&pool_)) {}
+    ~SideBook() = default;
+
+    /* add qty, return prev_best if best moved else INT_MIN */
+    int add(int idx,size_t vid,uint32_t qty){
+        if(!anchored_){ win0_ = idx-HALF_W; anchored_ = true; }
+        bool dense    = in_window(idx);
+        auto &pl      = dense ? window_[idx-win0_] : sparse_[idx];
+        bool first    = pl.agg==0;
+        pl.adjust(vid, int(qty));
+        account(dense, idx-win0_, int64_t(qty));
+        if(first && dense) occ_.set(idx-win0_);
+        if(first){ ++levels_; OB_STAT(++ctr_.creates); }
+        if(!dense) OB_STAT(++ctr_.sparse_hits);
+
+        int prev_best = best_;
+        if(better(idx,best_)) best_ = idx;
+        if(!dense) follow_best();
+        if(prev_best == EMPTY)
+            return std::numeric_limits<int>::min();  // ignore sentinel-to-real
+        return (best_ != prev_best) ? prev_best
+                                    : std::numeric_limits<int>::min();
+    }
+
+    /* remove qty, drop level if empty, move best cursor if it emptied */
+    void remove(int idx,size_t vid,uint32_t qty){
+        if(in_window(idx)){
+            auto &pl = window_[idx-win0_];
+            if(pl.agg==0) throw std::out_of_range("SideBook::remove: empty level");
+            pl.adjust(vid,-int(qty));
+            account(true, idx-win0_, -int64_t(qty));
+            if(pl.agg!=0) return;
+            occ_.clear(idx-win0_);
+        }else{
+            auto it = sparse_.find(idx);
+            if(it==sparse_.end()) throw std::out_of_range("SideBook::remove: empty level");
+            OB_STAT(++ctr_.sparse_hits);
+            it->second.adjust(vid,-int(qty));
+            account(false, 0, -int64_t(qty));
+            if(it->second.agg!=0) return;
+            sparse_.erase(it);
+        }
+        --levels_;
+        OB_STAT(++ctr_.deletes);
+        if(idx==best_){ best_ = rescan(); OB_STAT(++ctr_.rescans); }
+        follow_best();
+    }
+
+    /* drop every level and forget the window anchor; keeps the buffers */
+    void reset(){
+        for(int r=occ_.lowest(); r!=OccupancyBitmap::NONE; r=occ_.next_above(r))
+            window_[r] = PriceLevel{};
+        occ_ = OccupancyBitmap{};
+        sparse_.clear();
+        sums_.clear();
+        total_qty_ = 0;
+        levels_    = 0;
+        anchored_ = false;
+        best_     = EMPTY;
+    }
+
+    /* venue halt: zero vid on every level in one pass over the live
+       window (then the sparse levels), fix the aggregates and re-find
+       best once; returns the qty removed                              */
+    uint64_t clear_venue(size_t vid){
+        const uint16_t bit = uint16_t(1u<<vid);
+        uint64_t gone = 0;
+        for(uint64_t s=occ_.summary_; s; s&=s-1){
+            int w = __builtin_ctzll(s);
+            for(uint64_t m=occ_.words_[w]; m; m&=m-1){
+                int r = w*64 + __builtin_ctzll(m);
+                PriceLevel& pl = window_[r];
+                if(!(pl.mask & bit)) continue;
+                uint32_t q = pl.clear_venue(vid);
+                gone += q;
+                sums_.add(r, -int64_t(q));
+                if(!pl.agg){ occ_.clear(r); --levels_; OB_STAT(++ctr_.deletes); }
+            }
+        }
+        for(auto it=sparse_.begin(); it!=sparse_.end();){
+            if(!(it->second.mask & bit)){ ++it; continue; }
+            gone += it->second.clear_venue(vid);
+            if(it->second.agg){ ++it; continue; }
+            it = sparse_.erase(it);
+            --levels_;
+            OB_STAT(++ctr_.deletes);
+        }
+        if(!gone) return 0;
+        total_qty_ -= gone;
+        best_ = rescan();
+        OB_STAT(++ctr_.rescans);
+        follow_best();
+        return gone;
+    }
+
+    int  best_idx() const { return best_; }
+    bool empty() const { return best_==EMPTY; }
+#ifdef ORDERBOOK_STATS
+    const LevelCounters& counters() const { return ctr_; }
+    void reset_counters() { ctr_ = LevelCounters{}; }
+#endif
+    const PoolStats& pool_stats() const { return pool_.stats(); }
+
+    /* next live tick strictly worse than idx, or EMPTY; walks depth */
+    int next_worse(int idx) const {
+        int w = EMPTY;
+        if(anchored_){
+            long rel = long(idx) - win0_;
+            int  r;
+            if constexpr (IS_BID)
+                r = rel >= WINDOW ? occ_.highest()
+                  : rel <= 0      ? OccupancyBitmap::NONE : occ_.next_below(int(rel));
+            else
+                r = rel < 0          ? occ_.lowest()
+                  : rel >= WINDOW-1  ? OccupancyBitmap::NONE : occ_.next_above(int(rel));
+            if(r != OccupancyBitmap::NONE) w = win0_+r;
+        }
+        int sp = EMPTY;
+        if constexpr (IS_BID){
+            auto it = sparse_.lower_bound(idx);
+            if(it != sparse_.begin()) sp = std::prev(it)->first;
+        }else{
+            auto it = sparse_.upper_bound(idx);
+            if(it != sparse_.end()) sp = it->first;
+        }
+        return better(sp,w) ? sp : w;
+    }
+
+    /* ---------- aggregates ---------- */
+    uint64_t total_qty()   const { return total_qty_; }
+    size_t   level_count() const { return levels_; }
+
+    /* qty resting at the best and up to ticks worse than it */
+    uint64_t depth_within(int ticks) const {
+        if(empty() || ticks < 0) return 0;
+        long lo = IS_BID ? long(best_) - ticks : best_;          /* [lo, hi] in ticks */
+        long hi = IS_BID ? best_ : long(best_) + ticks;
+        uint64_t q = 0;
+        long wlo = std::max<long>(lo, win0_), whi = std::min<long>(hi, long(win0_)+WINDOW-1);
+        if(anchored_ && wlo <= whi) q += window_qty(int(wlo-win0_), int(whi-win0_));
+        for(auto it = sparse_.lower_bound(int(std::max<long>(lo, std::numeric_limits<int>::min())));
+            it != sparse_.end() && it->first <= hi; ++it)
+            q += it->second.agg;
+        return q;
+    }
+
+    /* walk from the touch taking up to qty: what it fills and for how much */
+    FillEstimate fill(uint64_t qty) const {
+        FillEstimate f;
+        auto take = [&](int idx,uint64_t avail){
+            uint64_t t = std::min<uint64_t>(avail, qty - f.qty);
+            f.qty += t; f.notional += int64_t(t)*idx; f.worst = idx;
+        };
+        const int wend = win0_ + WINDOW;
+        /* sparse levels better than the window (all of them if unanchored) */
+        if constexpr (IS_BID){
+            for(auto it = sparse_.rbegin(); it != sparse_.rend() && f.qty < qty
+                    && (!anchored_ || it->first >= wend); ++it) take(it->first, it->second.agg);
+        }else{
+            for(auto it = sparse_.begin(); it != sparse_.end() && f.qty < qty
+                    && (!anchored_ || it->first < win0_); ++it) take(it->first, it->second.agg);
+        }
+        /* the window, best word first: whole words while they fit, then
+           levels of the word that completes the fill                    */
+        for(int i=0; anchored_ && i<int(BITMAP_WORDS) && f.qty < qty; ++i){
+            int w = IS_BID ? int(BITMAP_WORDS)-1-i : i;
+            const WindowSums::Sum& ws = sums_.w[w];
+            uint64_t m = occ_.words_[w];
+            if(!m) continue;
+            if(uint64_t(ws.qty) <= qty - f.qty){
+                f.qty      += uint64_t(ws.qty);
+                f.notional += ws.rel_qty + ws.qty*int64_t(win0_);
+                f.worst     = win0_ + w*64 + (IS_BID ? __builtin_ctzll(m) : 63-__builtin_clzll(m));
+                continue;
+            }
+            while(f.qty < qty){
+                int b = IS_BID ? 63-__builtin_clzll(m) : __builtin_ctzll(m);
+                m &= ~(uint64_t(1)<<b);
+                take(win0_ + w*64 + b, window_[w*64 + b].agg);
+            }
+        }
+        /* sparse levels worse than the window */
+        if(anchored_ && f.qty < qty){
+            if constexpr (IS_BID){
+                for(auto it = std::make_reverse_iterator(sparse_.lower_bound(win0_));
+                    it != sparse_.rend() && f.qty < qty; ++it) take(it->first, it->second.agg);
+            }else{
+                for(auto it = sparse_.lower_bound(wend); it != sparse_.end() && f.qty < qty; ++it)
+                    take(it->first, it->second.agg);
+            }
+        }
+        return f;
+    }
+
+    /* live level at idx, or nullptr */
+    const PriceLevel* find(int idx) const {
+        if(in_window(idx)){
+            const auto& pl = window_[idx-win0_];
+            return pl.agg ? &pl : nullptr;
+        }
+        auto it = sparse_.find(idx);
+        return it==sparse_.end() ? nullptr : &it->second;
+    }
+    /* level at idx; an emptied level reads as all-zero */
+    const PriceLevel& level(int idx) const {
+        static const PriceLevel empty{};
+        const PriceLevel* pl = find(idx);
+        return pl ? *pl : empty;
+    }
+
+    /* ---------- snapshot support ---------- */
+    bool anchored() const { return anchored_; }
+    int  origin()   const { return win0_; }
+    /* f(idx, level) for every live level, window first, then sparse */
+    template<class F>
+    void for_each_level(F&& f) const {
+        for(int r=occ_.lowest(); r!=OccupancyBitmap::NONE; r=occ_.next_above(r))
+            f(win0_+r, window_[r]);
+        for(const auto& kv : sparse_) f(kv.first, kv.second);
+    }
+    /* on a reset() book: put the window where the saved one was */
+    void restore_anchor(int origin){ win0_ = origin; anchored_ = true; }
+    /* on a reset() book: install a saved level whole */
+    void restore_level(int idx,const PriceLevel& pl){
+        if(!pl.agg) return;
+        bool dense = in_window(idx);
+        if(dense){ window_[idx-win0_] = pl; occ_.set(idx-win0_); }
+        else sparse_[idx] = pl;
+        account(dense, idx-win0_, int64_t(pl.agg));
+        ++levels_;
+        if(better(idx,best_)) best_ = idx;
+    }
+};
+
+using BidBook = SideBook<Side::Bid>;
+using AskBook = SideBook<Side::Ask>;
+
+/* ---------- DepthView  (maintained top-N per side) ---------- */
+/*
+ * Top `depth` levels of each side, kept current as levels change.  A
+ * change below the view costs one compare; a qty/venue change inside it
+ * rewrites one slot; a level appearing or vanishing inside it re-walks N
+ * levels via next_worse().  Every slot that differs afterwards is
+ * appended to deltas() for the caller to drain.
+ */
+constexpr size_t MAX_DEPTH = 16;
+
+#pragma pack(push,1)
+struct DepthDelta {
+    uint8_t  side;          /* Side                             */
+    uint8_t  level;         /* 0 = best                         */
+    int32_t  price_ticks;   /* NO_TICK: slot is now empty       */
+    uint32_t agg;
+    uint16_t venue_mask;
+};
+#pragma pack(pop)
+static_assert(sizeof(DepthDelta) == 12, "DepthDelta must stay packed");
+
+struct DepthLevel {
+    int32_t  price{NO_TICK};
+    uint32_t agg{0};
+    uint16_t mask{0};
+    bool operator==(const DepthLevel& o) const {
+        return price==o.price && agg==o.agg && mask==o.mask;
+    }
+};
+
+class DepthView {
+    size_t depth_{0};                           /* 0 = disabled */
+    std::array<std::array<DepthLevel,MAX_DEPTH>,2> lv_{};
+    std::array<size_t,2> count_{};
+    std::vector<DepthDelta> deltas_;
+
+    void emit(Side s,size_t i,const DepthLevel& l){
+        deltas_.push_back({uint8_t(s), uint8_t(i), l.price, l.agg, l.mask});
+    }
+
+public:
+    void set_depth(size_t n){
+        if(n > MAX_DEPTH) throw std::invalid_argument("depth above MAX_DEPTH");
+        depth_ = n;
+        clear();
+    }
+    size_t depth()   const { return depth_; }
+    bool   enabled() const { return depth_!=0; }
+
+    size_t count(Side s) const { return count_[size_t(s)]; }
+    const DepthLevel& level(Side s,size_t i) const { return lv_[size_t(s)][i]; }
+
+    /* pending deltas, oldest first; the caller clears them once consumed */
+    std::vector<DepthDelta>& deltas() { return deltas_; }
+
+    /* forget the view (book reset); emits nothing */
+    void clear(){
+        for(auto& side : lv_) side.fill(DepthLevel{});
+        count_ = {};
+        deltas_.clear();
+    }
+
+    /* the level at idx on sb just changed */
+    template<Side S>
+    void touch(const SideBook<S>& sb,int idx){
+        auto&  v = lv_[size_t(S)];
+        size_t c = count_[size_t(S)];
+        if(c==depth_ && SideBook<S>::better(v[c-1].price, idx)) return;   /* below the view */
+        for(size_t i=0;i<c;++i){
+            if(v[i].price!=idx) continue;
+            const PriceLevel* pl = sb.find(idx);
+            if(!pl) break;                       /* level vanished: shift */
+            v[i].agg  = pl->agg;
+            v[i].mask = pl->mask;
+            emit(S,i,v[i]);
+            return;
+        }
+        refresh(sb);
+    }
+
+    /* rebuild one side from the book, emitting changed slots */
+    template<Side S>
+    void refresh(const SideBook<S>& sb){
+        auto&  v     = lv_[size_t(S)];
+        size_t old_c = count_[size_t(S)], c = 0;
+        for(int t=sb.best_idx(); c<depth_ && t!=SideBook<S>::EMPTY; t=sb.next_worse(t), ++c){
+            const PriceLevel& pl = sb.level(t);
+            DepthLevel nl{t, pl.agg, pl.mask};
+            if(c>=old_c || !(v[c]==nl)){ v[c] = nl; emit(S,c,nl); }
+        }
+        for(size_t i=c;i<old_c;++i){ v[i] = DepthLevel{}; emit(S,i,v[i]); }
+        count_[size_t(S)] = c;
+    }
+};
+
+/* ---------- VenueBboView  (per-venue best bid / offer) ---------- */
+/*
+ * Each venue's own best bid and offer, kept incrementally.  The view
+ * mirrors every level's venue mask, so a touch XORs old and new masks
+ * and only venues whose presence flipped touch their per-venue
+ * OccupancyBitmap; a venue whose best emptied re-finds it with one
+ * highest()/lowest() (plus a walk of the few out-of-window ticks).  A
+ * venue best that changes price or qty goes to deltas(); the
+ * consolidated market turning locked, crossed or normal again goes to
+ * market_changes(), judged once per message.
+ */
+#pragma pack(push,1)
+struct VenueBboDelta {
+    uint8_t  side;          /* Side                             */
+    uint8_t  venue;         /* Venue                            */
+    int32_t  price_ticks;   /* NO_TICK: venue has no quote now  */
+    uint32_t qty;           /* venue's qty at that price        */
+};
+enum MarketState : uint8_t { MKT_NORMAL = 0, MKT_LOCKED = 1, MKT_CROSSED = 2 };
+struct MarketChange {
+    uint8_t  state;         /* MarketState                      */
+    int32_t  bid_ticks;     /* consolidated best, NO_TICK if none */
+    int32_t  ask_ticks;
+    uint16_t bid_mask;      /* venues at those prices           */
+    uint16_t ask_mask;
+};
+#pragma pack(pop)
+static_assert(sizeof(VenueBboDelta) == 10, "VenueBboDelta must stay packed");
+static_assert(sizeof(MarketChange) == 13, "MarketChange must stay packed");
+
+struct VenueBbo {
+    int32_t  price{NO_TICK};
+    uint32_t qty{0};
+};
+
+class VenueBboView {
+    struct SideState {
+        bool                   anchored{false};
+        int                    win0{0};             /* SideBook's window origin */
+        std::vector<uint16_t>  mask;                /* WINDOW mirrored masks    */
+        std::map<int,uint16_t> sparse;              /* out-of-window masks      */
+        std::array<OccupancyBitmap,NUM_VENUES> occ{};
+        std::array<VenueBbo,NUM_VENUES>        best{};
+    };
+    bool                       on_{false};
+    std::array<SideState,2>    s_;
+    MarketState                market_{MKT_NORMAL};
+    std::vector<VenueBboDelta> deltas_;
+    std::vector<MarketChange>  market_changes_;
+
+    void emit(Side s,size_t v,const VenueBbo& b){
+        deltas_.push_back({uint8_t(s), uint8_t(v), b.price, b.qty});
+    }
+    /* venue v's best on sb after its best level lost v */
+    template<Side S>
+    VenueBbo rescan(const SideBook<S>& sb,const SideState& st,size_t v) const {
+        int r;
+        if constexpr (SideBook<S>::IS_BID) r = st.occ[v].highest();
+        else                               r = st.occ[v].lowest();
+        int best = r==OccupancyBitmap::NONE ? SideBook<S>::EMPTY : st.win0+r;
+        for(const auto& kv : st.sparse)
+            if(kv.second>>v & 1 && SideBook<S>::better(kv.first, best)) best = kv.first;
+        if(best==SideBook<S>::EMPTY) return VenueBbo{};
+        return VenueBbo{best, sb.level(best).vqty[v]};
+    }
+
+public:
+    bool enabled() const { return on_; }
+    void set_enabled(bool on){
+        on_ = on;
+        clear();
+        for(auto& st : s_) st.mask.assign(on ? WINDOW : 0, 0);
+    }
+
+    const VenueBbo& bbo(Side s,Venue v) const { return s_[size_t(s)].best[size_t(v)]; }
+    MarketState     market() const { return market_; }
+
+    /* pending records, oldest first; the caller clears them once consumed */
+    std::vector<VenueBboDelta>& deltas()         { return deltas_; }
+    std::vector<MarketChange>&  market_changes() { return market_changes_; }
+
+    /* forget everything (book reset); emits nothing */
+    void clear(){
+        for(auto& st : s_){
+            st.anchored = false;
+            std::fill(st.mask.begin(), st.mask.end(), uint16_t(0));
+            st.sparse.clear();
+            st.occ.fill(OccupancyBitmap{});
+            st.best.fill(VenueBbo{});
+        }
+        market_ = MKT_NORMAL;
+        deltas_.clear();
+        market_changes_.clear();
+    }
+
+    /* the level at idx on sb just changed */
+    template<Side S>
+    void touch(const SideBook<S>& sb,int idx){
+        SideState& st = s_[size_t(S)];
+        if(!st.anchored){ st.anchored = true; st.win0 = sb.origin(); }
+        const PriceLevel* pl = sb.find(idx);
+        uint16_t now   = pl ? pl->mask : 0;
+        bool     dense = unsigned(idx-st.win0) < unsigned(WINDOW);
+        int      rel   = idx-st.win0;
+        uint16_t was;
+        if(dense) was = st.mask[rel];
+        else{
+            auto it = st.sparse.find(idx);
+            was = it==st.sparse.end() ? 0 : it->second;
+        }
+        if(dense) st.mask[rel] = now;
+        else if(now) st.sparse[idx] = now;
+        else st.sparse.erase(idx);
+
+        for(uint16_t m = was ^ now; m; m &= m-1){
+            size_t v = size_t(__builtin_ctz(m));
+            VenueBbo& b = st.best[v];
+            if(now>>v & 1){
+                if(dense) st.occ[v].set(rel);
+                if(b.price==NO_TICK || SideBook<S>::better(idx, b.price)){
+                    b = VenueBbo{idx, pl->vqty[v]};
+                    emit(S,v,b);
+                }
+            }else{
+                if(dense) st.occ[v].clear(rel);
+                if(b.price==idx){ b = rescan(sb,st,v); emit(S,v,b); }
+            }
+        }
+        for(uint16_t m = was & now; m; m &= m-1){       /* qty moved at a venue best */
+            size_t v = size_t(__builtin_ctz(m));
+            VenueBbo& b = st.best[v];
+            if(b.price==idx && b.qty!=pl->vqty[v]){ b.qty = pl->vqty[v]; emit(S,v,b); }
+        }
+    }
+
+    /* venue v left every level of sb (SideBook::clear_venue) */
+    template<Side S>
+    void clear_venue(size_t v){
+        SideState& st = s_[size_t(S)];
+        const uint16_t keep = uint16_t(~(1u<<v));
+        const OccupancyBitmap& o = st.occ[v];
+        for(uint64_t s=o.summary_; s; s&=s-1){
+            int w = __builtin_ctzll(s);
+            for(uint64_t m=o.words_[w]; m; m&=m-1) st.mask[w*64 + __builtin_ctzll(m)] &= keep;
+        }
+        for(auto it=st.sparse.begin(); it!=st.sparse.end();){
+            it->second &= keep;
+            it = it->second ? std::next(it) : st.sparse.erase(it);
+        }
+        st.occ[v] = OccupancyBitmap{};
+        if(st.best[v].price!=NO_TICK){ st.best[v] = VenueBbo{}; emit(S,v,st.best[v]); }
+    }
+    /* sb was emptied wholesale (SideBook::reset); every venue best goes */
+    template<Side S>
+    void clear_side(){
+        SideState& st = s_[size_t(S)];
+        st.anchored = false;
+        std::fill(st.mask.begin(), st.mask.end(), uint16_t(0));
+        st.sparse.clear();
+        st.occ.fill(OccupancyBitmap{});
+        for(size_t v=0;v<NUM_VENUES;++v)
+            if(st.best[v].price!=NO_TICK){ st.best[v] = VenueBbo{}; emit(S,v,st.best[v]); }
+    }
+
+    /* judge the consolidated market; records a MarketChange on transitions */
+    void check_market(const BidBook& bid,const AskBook& ask){
+        MarketState st = MKT_NORMAL;
+        if(!bid.empty() && !ask.empty()){
+            int b = bid.best_idx(), a = ask.best_idx();
+            st = b==a ? MKT_LOCKED : b>a ? MKT_CROSSED : MKT_NORMAL;
+        }
+        if(st==market_) return;
+        market_ = st;
+        MarketChange c{uint8_t(st), NO_TICK, NO_TICK, 0, 0};
+        if(!bid.empty()){ c.bid_ticks = bid.best_idx(); c.bid_mask = bid.level(c.bid_ticks).mask; }
+        if(!ask.empty()){ c.ask_ticks = ask.best_idx(); c.ask_mask = ask.level(c.ask_ticks).mask; }
+        market_changes_.push_back(c);
+    }
+
+    /* rebuild from the books (view just turned on, or a restore); emits
+       one delta per quoting venue and the market state if not normal   */
+    void rebuild(const BidBook& bid,const AskBook& ask){
+        clear();
+        bid.for_each_level([&](int idx,const PriceLevel&){ touch(bid,idx); });
+        ask.for_each_level([&](int idx,const PriceLevel&){ touch(ask,idx); });
+        deltas_.clear();
+        for(Side s : {Side::Bid, Side::Ask})
+            for(size_t v=0;v<NUM_VENUES;++v)
+                if(s_[size_t(s)].best[v].price!=NO_TICK) emit(s,v,s_[size_t(s)].best[v]);
+        check_market(bid,ask);
+    }
+};
+
+/* ---------- order metadata ---------- */
+struct Meta{ int idx; uint32_t qty; uint8_t vid; Side side; uint16_t gen{0}; };  /* gen: see cancel_venue() */
+
+/* ---------- OrderMap  (uint64 oid → Meta, robin-hood) ---------- */
+/*
+ * Flat open-addressing table with the metadata (Meta, or L3Meta for
+ * books with order queues) stored inline.  Robin-hood
+ * insertion keeps probe lengths short and backward-shift deletion avoids
+ * tombstones, so lookups touch one or two cache lines and steady-state
+ * add/cancel never allocates.
+ */
+template<class V>
+class BasicOrderMap {
+    struct Slot{ uint64_t key; V meta; uint32_t dist; };   /* dist 0 = empty */
+    std::vector<Slot> slots_;
+    size_t mask_;
+    size_t size_{0};
+    int    shift_;
+#ifdef ORDERBOOK_STATS
+    MapCounters ctr_;
+#endif
+
+    size_t home(uint64_t key) const {
+        return size_t((key*0x9E3779B97F4A7C15ull) >> shift_);   /* fibonacci */
+    }
+    void erase_at(size_t i){
+        for(size_t j=(i+1)&mask_; slots_[j].dist>1; i=j, j=(j+1)&mask_){
+            slots_[i] = slots_[j];                  /* backward shift */
+            --slots_[i].dist;
+        }
+        slots_[i].dist = 0;
+        --size_;
+    }
+    void grow(){
+        std::vector<Slot> old(slots_.size()*2);
+        old.swap(slots_);
+        mask_  = slots_.size()-1;
+        --shift_;
+        size_  = 0;
+        for(const auto& s : old)
+            if(s.dist) insert(s.key,s.meta);
+    }
+
+public:
+    explicit BasicOrderMap(size_t capacity = 1024){
+        size_t cap = 16; int bits = 4;
+        while(cap < capacity){ cap <<= 1; ++bits; }
+        slots_.resize(cap);
+        mask_  = cap-1;
+        shift_ = 64-bits;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return slots_.size(); }
+    bool   at_capacity() const { return (size_+1)*8 > slots_.size()*7; }   /* next insert grows */
+    void   clear(){ for(auto& s : slots_) s.dist = 0; size_ = 0; }
+    /* f(key, meta) for every entry, in slot order */
+    template<class F>
+    void for_each(F&& f) const { for(const auto& s : slots_) if(s.dist) f(s.key, s.meta); }
+
+    V* find(uint64_t key){
+        OB_STAT(++ctr_.lookups);
+        size_t i = home(key);
+        for(uint32_t d=1;; ++d, i=(i+1)&mask_){
+            OB_STAT(++ctr_.probes);
+            Slot& s = slots_[i];
+            if(s.dist < d) return nullptr;          /* empty or richer slot */
+            if(s.key==key) return &s.meta;
+        }
+    }
+
+    /* insert or overwrite; returns the stored Meta */
+    V& insert(uint64_t key,const V& meta){
+        if((size_+1)*8 > slots_.size()*7) grow();
+        OB_STAT(++ctr_.lookups);
+        Slot cur{key,meta,1};
+        V* placed = nullptr;
+        for(size_t i=home(key);; i=(i+1)&mask_){
+            OB_STAT(++ctr_.probes);
+            Slot& s = slots_[i];
+            if(!s.dist){
+                s = cur; ++size_;
+                return placed ? *placed : s.meta;
+            }
+            if(s.key==cur.key && !placed){
+                s.meta = cur.meta;
+                return s.meta;
+            }
+            if(s.dist < cur.dist){                  /* steal from the rich */
+                std::swap(s,cur);
+                if(!placed) placed = &s.meta;
+            }
+            ++cur.dist;
+        }
+    }
+
+    bool erase(uint64_t key){
+        OB_STAT(++ctr_.lookups);
+        size_t i = home(key);
+        for(uint32_t d=1;; ++d, i=(i+1)&mask_){
+            OB_STAT(++ctr_.probes);
+            if(slots_[i].dist < d) return false;
+            if(slots_[i].key==key) break;
+        }
+        erase_at(i);
+        return true;
+    }
+    /* erase every entry with pred(key, meta); returns how many.  One
+       pass: a backward shift only moves entries into the slot just
+       checked, so that slot is checked again before moving on.     */
+    template<class P>
+    size_t erase_if(P&& pred){
+        size_t n = 0;
+        for(size_t i=0;i<slots_.size();){
+            if(slots_[i].dist && pred(slots_[i].key, static_cast<const V&>(slots_[i].meta))){ erase_at(i); ++n; }
+            else ++i;
+        }
+        return n;
+    }
+#ifdef ORDERBOOK_STATS
+    const MapCounters& counters() const { return ctr_; }
+    void reset_counters() { ctr_ = MapCounters{}; }
+#endif
+};
+using OrderMap = BasicOrderMap<Meta>;
+
+/* ---------- StringOrderMap  (string oid → Meta) ---------- */
+/* node-based map for feeds with string IDs; same interface as OrderMap */
+template<class V>
+class BasicStringOrderMap {
+    using Alloc = PoolAllocator<std::pair<const std::string,V>>;
+    NodePool pool_;                             /* hash nodes; keys past
+                                                   the SSO length still
+                                                   use the heap          */
+    std::unordered_map<std::string,V,std::hash<std::string>,
+                       std::equal_to<std::string>,Alloc> map_;
+#ifdef ORDERBOOK_STATS
+    MapCounters ctr_;                           /* probes = chain nodes walked */
+    void count_probes(const std::string& key){
+        ++ctr_.lookups;
+        size_t b = map_.bucket(key);
+        ctr_.probes += 1 + map_.bucket_size(b);
+    }
+#endif
+public:
+    BasicStringOrderMap() : pool_(1024), map_(16, std::hash<std::string>(),
+                                         std::equal_to<std::string>(), Alloc(&pool_)) {}
+    const PoolStats& pool_stats() const { return pool_.stats(); }
+    size_t size() const { return map_.size(); }
+    bool   at_capacity() const { return float(map_.size()+1) > float(map_.bucket_count())*map_.max_load_factor(); }
+    void   clear(){ map_.clear(); }
+    template<class F>
+    void for_each(F&& f) const { for(const auto& kv : map_) f(kv.first, kv.second); }
+    V* find(const std::string& key){
+        OB_STAT(count_probes(key));
+        auto it = map_.find(key);
+        return it==map_.end() ? nullptr : &it->second;
+    }
+    V& insert(const std::string& key,const V& meta){
+        OB_STAT(count_probes(key));
+        return map_[key] = meta;
+    }
+    bool erase(const std::string& key){
+        OB_STAT(count_probes(key));
+        return map_.erase(key)!=0;
+    }
+    template<class P>
+    size_t erase_if(P&& pred){
+        size_t n = 0;
+        for(auto it=map_.begin(); it!=map_.end();){
+            if(pred(it->first, static_cast<const V&>(it->second))){ it = map_.erase(it); ++n; }
+            else ++it;
+        }
+        return n;
+    }
+#ifdef ORDERBOOK_STATS
+    const MapCounters& counters() const { return ctr_; }
+    void reset_counters() { ctr_ = MapCounters{}; }
+#endif
+};
+using StringOrderMap = BasicStringOrderMap<Meta>;
+
+/* ---------- order queues (L3) ---------- */
+/*
+ * Queue policy of BasicOrderBookCore.  NoQueues (OrderBookCore) keeps
+ * only the per-venue aggregates in PriceLevel and compiles every hook
+ * away.  FifoQueues also keeps each resting order as a pooled node in the
+ * FIFO of its (side, price, venue); the node handle sits in the order's
+ * map entry, so cancel and execute unlink in O(1).
+ *
+ * Position ahead (live qty and orders queued in front at the same price
+ * and venue) is O(1) for watch()ed orders: their queue lists them and
+ * every reduction ahead of one adjusts it directly.  Exact O(1) answers
+ * for every order would need a prefix sum per update, so unwatched
+ * orders are answered by walking to the front.
+ *
+ * Priority: a replace keeps its place only if the oid, price and venue
+ * are unchanged and qty does not grow; anything else rejoins at the back.
+ */
+struct NoQueues {
+    static constexpr bool TRACKS_ORDERS = false;
+    using meta_type = Meta;
+    void enqueue(Meta&) {}
+    void remove(const Meta&) {}
+    void reduce(Meta&,uint32_t) {}
+    void clear() {}
+    template<class P> void drop_if(P&&) {}
+};
+
+struct OrderQueue;
+struct OrderNode {
+    OrderNode*  prev;
+    OrderNode*  next;
+    OrderQueue* queue;
+    uint64_t    seq;            /* arrival order within the book        */
+    uint32_t    qty;
+    uint32_t    ahead_qty;      /* watched nodes only                   */
+    uint32_t    ahead_orders;
+    bool        watched;
+};
+struct OrderQueue {
+    OrderNode* head{nullptr};
+    OrderNode* tail{nullptr};
+    uint32_t   qty{0};
+    uint32_t   orders{0};
+    std::vector<OrderNode*> watched;
+};
+struct QueuePosition {
+    uint32_t qty_ahead;
+    uint32_t orders_ahead;
+};
+
+/* Meta plus the order's queue node */
+struct L3Meta : Meta {
+    OrderNode* node{nullptr};
+};
+
+class FifoQueues {
+    using Key   = uint64_t;                     /* idx | venue | side */
+    using Alloc = PoolAllocator<std::pair<const Key,OrderQueue>>;
+
+    NodePool nodes_;
+    NodePool qpool_;
+    std::unordered_map<Key,OrderQueue,std::hash<Key>,std::equal_to<Key>,Alloc> queues_;
+    uint64_t seq_{0};
+
+    static Key key(Side s,int idx,uint8_t vid){
+        return uint64_t(uint32_t(idx))<<8 | uint64_t(vid)<<1 | uint64_t(s==Side::Ask);
+    }
+    /* node y loses d qty (and leaves the queue if gone): settle watchers behind it */
+    static void charge(OrderQueue& q,const OrderNode* y,uint32_t d,bool gone){
+        for(OrderNode* w : q.watched)
+            if(w->seq > y->seq){ w->ahead_qty -= d; w->ahead_orders -= gone; }
+    }
+    void free_nodes(OrderQueue& q){
+        for(OrderNode* n=q.head; n;){ OrderNode* nx=n->next; nodes_.free(n); n=nx; }
+    }
+    static QueuePosition walk(const OrderNode* n){
+        QueuePosition p{0,0};
+        for(const OrderNode* a=n->prev; a; a=a->prev){ p.qty_ahead += a->qty; ++p.orders_ahead; }
+        return p;
+    }
+
+public:
+    static constexpr bool TRACKS_ORDERS = true;
+    using meta_type = L3Meta;
+
+    FifoQueues() : nodes_(1024), qpool_(256),
+                   queues_(16, std::hash<Key>(), std::equal_to<Key>(), Alloc(&qpool_)) {
+        nodes_.owns(sizeof(OrderNode), alignof(OrderNode));
+    }
+    FifoQueues(const FifoQueues&) = delete;
+    FifoQueues& operator=(const FifoQueues&) = delete;
+
+    /* append m's qty at the back of its queue */
+    void enqueue(L3Meta& m){
+        OrderQueue& q = queues_[key(m.side,m.idx,m.vid)];
+        auto* n = static_cast<OrderNode*>(nodes_.alloc());
+        *n = OrderNode{q.tail, nullptr, &q, ++seq_, m.qty, 0, 0, false};
+        (q.tail ? q.tail->next : q.head) = n;
+        q.tail = n;
+        q.qty += m.qty; ++q.orders;
+        m.node = n;
+    }
+    void remove(const L3Meta& m){
+        OrderNode* n = m.node;
+        if(!n) return;
+        OrderQueue& q = *n->queue;
+        charge(q,n,n->qty,true);
+        if(n->watched) q.watched.erase(std::find(q.watched.begin(), q.watched.end(), n));
+        (n->prev ? n->prev->next : q.head) = n->next;
+        (n->next ? n->next->prev : q.tail) = n->prev;
+        q.qty -= n->qty; --q.orders;
+        nodes_.free(n);
+        if(!q.head) queues_.erase(key(m.side,m.idx,m.vid));
+    }
+    /* partial fill or qty-down replace: keeps its place */
+    void reduce(L3Meta& m,uint32_t by){
+        OrderNode* n = m.node;
+        if(!n || !by) return;
+        if(by >= n->qty){ remove(m); m.node = nullptr; return; }
+        charge(*n->queue,n,by,false);
+        n->qty -= by;
+        n->queue->qty -= by;
+    }
+    void clear(){
+        for(auto& kv : queues_) free_nodes(kv.second);
+        queues_.clear();
+    }
+    /* drop whole queues with pred(side, vid) (bulk cancels); the orders'
+       node handles dangle, so their map entries must go as well        */
+    template<class P>
+    void drop_if(P&& pred){
+        for(auto it=queues_.begin(); it!=queues_.end();){
+            Side s = it->first & 1 ? Side::Ask : Side::Bid;
+            if(!pred(s, uint8_t(it->first>>1 & 0x7f))){ ++it; continue; }
+            free_nodes(it->second);
+            it = queues_.erase(it);
+        }
+    }
+
+    /* start O(1) tracking of m's position; lasts until it leaves its queue */
+    void watch(const L3Meta& m){
+        OrderNode* n = m.node;
+        if(!n || n->watched) return;
+        QueuePosition p = walk(n);
+        n->ahead_qty = p.qty_ahead; n->ahead_orders = p.orders_ahead;
+        n->watched = true;
+        n->queue->watched.push_back(n);
+    }
+    void unwatch(const L3Meta& m){
+        OrderNode* n = m.node;
+        if(!n || !n->watched) return;
+        auto& w = n->queue->watched;
+        w.erase(std::find(w.begin(), w.end(), n));
+        n->watched = false;
+    }
+    QueuePosition position(const L3Meta& m) const {
+        const OrderNode* n = m.node;
+        if(n->watched) return {n->ahead_qty, n->ahead_orders};
+        return walk(n);
+    }
+
+    /* FIFO at (side, price, venue), or nullptr if nothing rests there */
+    const OrderQueue* queue(Side s,int idx,Venue v) const {
+        auto it = queues_.find(key(s,idx,uint8_t(v)));
+        return it==queues_.end() ? nullptr : &it->second;
+    }
+    const PoolStats& pool_stats() const { return nodes_.stats(); }
+};
+
+/* node-pool usage of one book; integer orders live inline in OrderMap */
+struct BookPoolStats {
+    PoolStats bid_levels;       /* out-of-window levels */
+    PoolStats ask_levels;
+    PoolStats string_orders;
+    size_t    int_order_slots;
+};
+
+/* ---------- top of book ---------- */
+/* a side's best level, kept across a bulk operation or a conflated batch */
+struct Top {
+    int      idx{NO_TICK};
+    uint32_t agg{0};
+    uint16_t mask{0};
+    VenueQty vqty{};
+};
+/* one EV_NBBO if the best price or size moved from pre to now; old_* and
+   vqty describe pre, idx is NO_TICK (agg 0) for a side left empty      */
+template<class Sink>
+inline void report_top(const Top& now,const Top& pre,Sink& out){
+    if(now.idx==pre.idx && now.agg==pre.agg) return;
+    out.push_back(BookEvent{EV_NBBO, now.idx, now.agg, pre.idx, pre.agg, pre.mask, pre.vqty});
+}
+
+/* ---------- OrderBookCore ---------- */
+/*
+ * One instrument's book with no Python dependency.  Message methods take
+ * integer ticks and return true when they produced an event, which is
+ * written to ev.  Safe to drive from any native thread (one thread per
+ * book at a time).  Queues is NoQueues (OrderBookCore, aggregates only)
+ * or FifoQueues (L3OrderBookCore, per-order FIFOs).
+ */
+template<class Queues>
+class BasicOrderBookCore {
+public:
+    using queues_type = Queues;
+    using meta_type   = typename Queues::meta_type;
+
+private:
+    BidBook bid_;
+    AskBook ask_;
+
+    BasicStringOrderMap<meta_type> omap_;
+    BasicOrderMap<meta_type>       imap_;        /* integer-oid fast path */
+    DepthView      depth_;                       /* off unless enable_depth() */
+    VenueBboView   venues_;                      /* off unless enable_venue_bbo() */
+    Queues         queues_;
+    std::array<std::array<uint16_t,NUM_VENUES>,2> gen_{};   /* per (side, venue) */
+    bool           stale_{false};                /* maps may hold retired orders */
+#ifdef ORDERBOOK_STATS
+    std::array<LogHistogram,NUM_OPS> lat_;       /* cycles per public call */
+#endif
+
+    template<class Book>
+    void touched(const Book& sb,int idx){
+        if(depth_.enabled())  depth_.touch(sb,idx);
+        if(venues_.enabled()) venues_.touch(sb,idx);
+    }
+    /* end of one message: lock/cross is judged on the final state */
+    void settle(){ if(venues_.enabled()) venues_.check_market(bid_,ask_); }
+    bool settled(bool has_event){ settle(); return has_event; }
+
+    /* call f with the side's book; the one runtime side branch per message,
+       after which everything inlines against SideBook<Bid> or <Ask>       */
+    template<class F>
+    decltype(auto) with_side(Side s,F&& f){
+        return s==Side::Bid ? f(bid_) : f(ask_);
+    }
+    template<class F>
+    decltype(auto) with_side(Side s,F&& f) const {
+        return s==Side::Bid ? f(bid_) : f(ask_);
+    }
+
+    template<class Book>
+    static Top top_of(const Book& sb){
+        if(sb.empty()) return Top{};
+        const PriceLevel& pl = sb.level(sb.best_idx());
+        return Top{sb.best_idx(), pl.agg, pl.mask, pl.vqty};
+    }
+    /* after a bulk change to sb: views once, then the NBBO event */
+    template<class Book,class Sink>
+    void bulk_done(const Book& sb,const Top& pre,Sink& out){
+        if(depth_.enabled()) depth_.refresh(sb);
+        report_top(top_of(sb), pre, out);
+    }
+
+    template<class Sink>
+    uint64_t clear_side_impl(Side s,Sink& out){
+        for(size_t v=0;v<NUM_VENUES;++v) bump(s,v);
+        queues_.drop_if([s](Side qs,uint8_t){ return qs==s; });
+        return with_side(s,[&](auto& sb) -> uint64_t {
+            using Book = std::decay_t<decltype(sb)>;
+            if(sb.empty()) return 0;
+            uint64_t gone = sb.total_qty();
+            Top pre = top_of(sb);
+            sb.reset();
+            if(venues_.enabled()) venues_.template clear_side<Book::SIDE>();
+            bulk_done(sb, pre, out);
+            return gone;
+        });
+    }
+
+    /* ---------- order generations ---------- */
+    /* an order is live while its gen matches its (side, venue) here */
+    bool live(const Meta& m) const { return m.gen==gen_[size_t(m.side)][m.vid]; }
+    Meta stamped(Meta m) const { m.gen = gen_[size_t(m.side)][m.vid]; return m; }
+    /* retire every order of (s, vid) at once; before the counter wraps,
+       sweep so no stale entry can come back to life                    */
+    void bump(Side s,size_t vid){
+        uint16_t& g = gen_[size_t(s)][vid];
+        if(g==UINT16_MAX) purge();
+        ++g;
+        stale_ = true;
+    }
+    void purge(){
+        auto dead = [this](const auto&,const Meta& m){ return !live(m); };
+        imap_.erase_if(dead);
+        omap_.erase_if(dead);
+        stale_ = false;
+    }
+    /* find oid; an entry a bulk cancel retired is erased and not found */
+    template<class Map,class Id>
+    meta_type* find_live(Map& map,const Id& oid){
+        meta_type* m = map.find(oid);
+        if(m && !live(*m)){ map.erase(oid); return nullptr; }
+        return m;
+    }
+    /* before an insert: rather than grow over retired entries, drop them */
+    template<class Map>
+    void make_room(const Map& map){ if(stale_ && map.at_capacity()) purge(); }
+
+    /* apply an add to its level; fills ev and returns true if the best moved */
+    template<class Book>
+    static bool add_level(Book& sb,int idx,size_t vid,uint32_t qty,BookEvent& ev){
+        int prev_best = sb.add(idx,vid,qty);
+        if(prev_best==std::numeric_limits<int>::min()) return false;
+        const auto& old_pl = sb.level(prev_best);
+        ev = {EV_NBBO, idx, sb.level(idx).agg, prev_best, old_pl.agg, old_pl.mask, old_pl.vqty};
+        return true;
+    }
+    /* take exec_qty off an order, describe the level it left behind */
+    template<class Book>
+    static uint32_t execute_order(Book& sb,Meta& m,uint32_t exec_qty,BookEvent& ev){
+        uint32_t take = std::min(exec_qty, m.qty);
+        m.qty    -= take;
+        sb.remove(m.idx, m.vid, take);
+
+        const PriceLevel& pl = sb.level(m.idx);
+        ev = {EV_EXEC, m.idx, pl.agg, 0, 0, pl.mask, pl.vqty};
+        return take;
+    }
+
+    template<class Map,class Id>
+    bool add_impl(Map& map,const Id& oid,Venue v,Side s,int idx,uint32_t qty,BookEvent& ev){
+        make_room(map);
+        queues_.enqueue(map.insert(oid,meta_type{stamped(Meta{idx,qty,uint8_t(v),s})}));
+        return with_side(s,[&](auto& sb){
+            bool moved = add_level(sb,idx,size_t(v),qty,ev);
+            touched(sb,idx);
+            return moved;
+        });
+    }
+    /* replace in one pass: one lookup of old_oid, qty adjusted in place if
+       side/price/venue are unchanged, and at most one NBBO event judged
+       against the book after the replace (old_* = previous best level as
+       it now stands).  An unknown old_oid makes this a plain add.  With
+       queues the order keeps its place only for a same-oid, same-level
+       replace that does not grow.                                       */
+    template<class Map,class Id>
+    bool replace_impl(Map& map,const Id& new_oid,const Id& old_oid,Venue v,Side s,
+                      int idx,uint32_t qty,BookEvent& ev){
+        meta_type* m = find_live(map,old_oid);
+        if(!m) return add_impl(map,new_oid,v,s,idx,qty,ev);
+        meta_type old = *m;
+        meta_type now = old;
+        static_cast<Meta&>(now) = stamped(Meta{idx,qty,uint8_t(v),s});
+        return with_side(s,[&](auto& sb){
+            using Book = std::decay_t<decltype(sb)>;
+            int pre = sb.best_idx();
+            bool same_level = old.side==s && old.idx==idx && old.vid==now.vid;
+            if(same_level){
+                if(qty > old.qty)      sb.add(idx, now.vid, qty-old.qty);
+                else if(qty < old.qty) sb.remove(idx, now.vid, old.qty-qty);
+            }else{
+                with_side(old.side,[&](auto& osb){
+                    osb.remove(old.idx, old.vid, old.qty);
+                    touched(osb, old.idx);
+                });
+                if(qty) sb.add(idx, now.vid, qty);
+            }
+            touched(sb, idx);
+            if constexpr (Queues::TRACKS_ORDERS){
+                if(same_level && new_oid==old_oid && qty<=old.qty)
+                    queues_.reduce(now, old.qty-qty);
+                else{
+                    queues_.remove(old);
+                    now.node = nullptr;
+                    if(qty) queues_.enqueue(now);
+                }
+            }
+
+            if(new_oid==old_oid && qty) *m = now;        /* same slot */
+            else{
+                map.erase(old_oid);
+                if(qty){ make_room(map); map.insert(new_oid, now); }
+            }
+
+            int post = sb.best_idx();
+            if(pre==Book::EMPTY || !Book::better(post, pre)) return false;
+            const PriceLevel& old_pl = sb.level(pre);
+            ev = {EV_NBBO, post, sb.level(post).agg, pre, old_pl.agg, old_pl.mask, old_pl.vqty};
+            return true;
+        });
+    }
+    template<class Map,class Id>
+    void cancel_impl(Map& map,const Id& oid){
+        meta_type* m=find_live(map,oid); if(!m) return;
+        meta_type copy=*m; map.erase(oid);
+        queues_.remove(copy);
+        with_side(copy.side,[&](auto& sb){
+            sb.remove(copy.idx,copy.vid,copy.qty);
+            touched(sb,copy.idx);
+        });
+    }
+    template<class Map,class Id>
+    bool execute_impl(Map& map,const Id& oid,uint32_t exec_qty,BookEvent& ev){
+        meta_type* m = find_live(map,oid);
+        if(!m) return false;
+        with_side(m->side,[&](auto& sb){
+            queues_.reduce(*m, execute_order(sb,*m,exec_qty,ev));
+            touched(sb,m->idx);
+        });
+        if(m->qty==0) map.erase(oid);
+        return true;
+    }
+
+public:
+    BasicOrderBookCore() = default;
+
+    /* ---------- single-message API ---------- */
+    bool add(uint64_t oid,Venue v,Side s,int idx,uint32_t qty,BookEvent& ev){
+        OB_TIME(lat_[OP_ADD]);
+        return settled(add_impl(imap_,oid,v,s,idx,qty,ev));
+    }
+    bool add(const std::string& oid,Venue v,Side s,int idx,uint32_t qty,BookEvent& ev){
+        OB_TIME(lat_[OP_ADD]);
+        return settled(add_impl(omap_,oid,v,s,idx,qty,ev));
+    }
+    void cancel(uint64_t oid)           { OB_TIME(lat_[OP_CANCEL]); cancel_impl(imap_,oid); settle(); }
+    void cancel(const std::string& oid) { OB_TIME(lat_[OP_CANCEL]); cancel_impl(omap_,oid); settle(); }
+
+    bool replace(uint64_t new_oid,uint64_t old_oid,Venue v,Side s,
+                 int idx,uint32_t qty,BookEvent& ev){
+        OB_TIME(lat_[OP_REPLACE]);
+        return settled(replace_impl(imap_,new_oid,old_oid,v,s,idx,qty,ev));
+    }
+    bool replace(const std::string& new_oid,const std::string& old_oid,Venue v,Side s,
+                 int idx,uint32_t qty,BookEvent& ev){
+        OB_TIME(lat_[OP_REPLACE]);
+        return settled(replace_impl(omap_,new_oid,old_oid,v,s,idx,qty,ev));
+    }
+
+    bool execute(uint64_t oid,uint32_t exec_qty,BookEvent& ev){
+        OB_TIME(lat_[OP_EXECUTE]);
+        return settled(execute_impl(imap_,oid,exec_qty,ev));
+    }
+    bool execute(const std::string& oid,uint32_t exec_qty,BookEvent& ev){
+        OB_TIME(lat_[OP_EXECUTE]);
+        return settled(execute_impl(omap_,oid,exec_qty,ev));
+    }
+
+    /* ---------- batch API ---------- */
+    /* one fixed-width record (MsgRecord or anything with its fields);
+       Sink needs push_back(BookEvent)                                  */
+    template<class Rec,class Sink>
+    void apply_one(const Rec& r,Sink& out){
+        BookEvent ev;
+        switch(r.msg_type){
+        case MSG_ADD:
+        case MSG_REPLACE: {
+            if(r.venue>=NUM_VENUES) throw std::out_of_range("venue id out of range");
+            if(r.side>uint8_t(Side::Ask)) throw std::out_of_range("side out of range");
+            Side s = Side(r.side);
+            bool has = r.msg_type==MSG_ADD
+                ? add(r.oid,Venue(r.venue),s,r.price_ticks,r.qty,ev)
+                : replace(r.oid,r.old_oid,Venue(r.venue),s,r.price_ticks,r.qty,ev);
+            if(has) out.push_back(ev);
+            break;
+        }
+        case MSG_CANCEL:
+            cancel(r.oid);
+            break;
+        case MSG_EXECUTE:
+            if(execute(r.oid,r.qty,ev)) out.push_back(ev);
+            break;
+        default:
+            throw std::runtime_error("Bad msg_type");
+        }
+    }
+    template<class Sink>
+    void apply(const MsgRecord* recs,size_t n,Sink& out){
+        for(size_t i=0;i<n;++i) apply_one(recs[i],out);
+    }
+    /* apply() with NBBO moves collapsed to one event per side (see
+       ConflatingSink); executions still come out in order            */
+    template<class Sink>
+    void apply_conflated(const MsgRecord* recs,size_t n,Sink& out);
+
+    /* ---------- bulk session operations ---------- */
+    /*
+     * For a venue halt or a dropped session, instead of one cancel per
+     * order: each side is edited in one pass over its live levels, the
+     * views refreshed and the market judged once.  The orders themselves
+     * are retired by bumping the generation of their (side, venue), so
+     * no order map is walked; a retired entry is erased when its oid is
+     * next looked up, or swept before the map would grow.  out gets at
+     * most one EV_NBBO per side (bid first) if that side's best price or
+     * size changed; old_* and vqty describe the best before, idx is
+     * NO_TICK for a side left empty.  Return the qty taken off the book.
+     */
+    template<class Sink>
+    uint64_t cancel_venue(Venue v,Sink& out){
+        const size_t vid = size_t(v);
+        uint64_t gone = 0;
+        for(Side s : {Side::Bid, Side::Ask}){
+            bump(s, vid);
+            with_side(s,[&](auto& sb){
+                using Book = std::decay_t<decltype(sb)>;
+                Top pre = top_of(sb);
+                uint64_t q = sb.clear_venue(vid);
+                if(!q) return;
+                gone += q;
+                if(venues_.enabled()) venues_.template clear_venue<Book::SIDE>(vid);
+                bulk_done(sb, pre, out);
+            });
+        }
+        queues_.drop_if([vid](Side,uint8_t qv){ return qv==vid; });
+        settle();
+        return gone;
+    }
+    template<class Sink>
+    uint64_t clear_side(Side s,Sink& out){
+        uint64_t gone = clear_side_impl(s, out);
+        settle();
+        return gone;
+    }
+    /* both sides; unlike reset() the views stay on and report the change */
+    template<class Sink>
+    uint64_t cancel_all(Sink& out){
+        uint64_t gone = clear_side_impl(Side::Bid, out) + clear_side_impl(Side::Ask, out);
+        settle();
+        return gone;
+    }
+
+    /* empty the book so it can be reused for another instrument */
+    void reset(){
+        bid_.reset(); ask_.reset();
+        omap_.clear(); imap_.clear();
+        gen_ = {}; stale_ = false;
+        depth_.clear();
+        venues_.clear();
+        queues_.clear();
+    }
+
+    /* ---------- depth view ---------- */
+    /* maintain the top n levels per side (0 turns it off) */
+    void enable_depth(size_t n){
+        depth_.set_depth(n);
+        if(n){ depth_.refresh(bid_); depth_.refresh(ask_); }
+    }
+    DepthView&       depth()       { return depth_; }
+    const DepthView& depth() const { return depth_; }
+
+    /* ---------- per-venue BBO ---------- */
+    /* track every venue's own best bid/offer and lock/cross transitions */
+    void enable_venue_bbo(bool on){
+        venues_.set_enabled(on);
+        if(on) venues_.rebuild(bid_, ask_);
+    }
+    VenueBboView&       venue_bbo()       { return venues_; }
+    const VenueBboView& venue_bbo() const { return venues_; }
+
+    /* ---------- queries ---------- */
+    template<Side S>
+    const SideBook<S>& book() const {
+        if constexpr (S==Side::Bid) return bid_;
+        else                        return ask_;
+    }
+    int  best_idx(Side s) const { return with_side(s,[](const auto& sb){ return sb.best_idx(); }); }
+    /* side s's best level as it stands (Top{} if the side is empty) */
+    Top  top(Side s)      const { return with_side(s,[](const auto& sb){ return top_of(sb); }); }
+    bool empty(Side s)    const { return with_side(s,[](const auto& sb){ return sb.empty(); }); }
+    /* live level at idx on side s, or nullptr */
+    const PriceLevel* find(Side s,int idx) const {
+        return with_side(s,[idx](const auto& sb){ return sb.find(idx); });
+    }
+    /* running aggregates (see SideBook) */
+    uint64_t total_qty(Side s)   const { return with_side(s,[](const auto& sb){ return sb.total_qty(); }); }
+    size_t   level_count(Side s) const { return with_side(s,[](const auto& sb){ return sb.level_count(); }); }
+    uint64_t depth_within(Side s,int ticks) const {
+        return with_side(s,[ticks](const auto& sb){ return sb.depth_within(ticks); });
+    }
+    FillEstimate fill(Side s,uint64_t qty) const {
+        return with_side(s,[qty](const auto& sb){ return sb.fill(qty); });
+    }
+    BookPoolStats pool_stats() const {
+        return {bid_.pool_stats(), ask_.pool_stats(), omap_.pool_stats(), imap_.capacity()};
+    }
+
+    /* ---------- instrumentation (all zero unless ORDERBOOK_STATS) ---------- */
+    BookStats stats() const {
+        BookStats st;
+#ifdef ORDERBOOK_STATS
+        st.latency = lat_;
+        st.levels  = bid_.counters();
+        st.levels.merge(ask_.counters());
+        st.int_orders    = imap_.counters();
+        st.string_orders = omap_.counters();
+#endif
+        return st;
+    }
+    void reset_stats(){
+#ifdef ORDERBOOK_STATS
+        for(auto& h : lat_) h.reset();
+        bid_.reset_counters(); ask_.reset_counters();
+        imap_.reset_counters(); omap_.reset_counters();
+#endif
+    }
+
+    /* ---------- snapshot support (snapshot.hpp) ---------- */
+    /* f(oid, meta) for every open order; oid is uint64_t or std::string */
+    template<class F>
+    void for_each_order(F&& f) const {
+        auto each = [&](const auto& oid,const meta_type& m){ if(live(m)) f(oid,m); };
+        imap_.for_each(each); omap_.for_each(each);
+    }
+    /* restore into a reset() book: anchors, then levels, then orders in
+       queue order; orders do not touch the levels they rest on       */
+    void restore_anchor(Side s,int origin){
+        with_side(s,[origin](auto& sb){ sb.restore_anchor(origin); });
+    }
+    void restore_level(Side s,int idx,const PriceLevel& pl){
+        with_side(s,[&](auto& sb){ sb.restore_level(idx,pl); });
+    }
+    void restore_order(uint64_t oid,const Meta& m)           { queues_.enqueue(imap_.insert(oid,meta_type{stamped(m)})); }
+    void restore_order(const std::string& oid,const Meta& m) { queues_.enqueue(omap_.insert(oid,meta_type{stamped(m)})); }
+    /* after the last restore_*(): rebuild the views that are on */
+    void restore_done(){
+        if(depth_.enabled()){ depth_.refresh(bid_); depth_.refresh(ask_); }
+        if(venues_.enabled()) venues_.rebuild(bid_, ask_);
+    }
+
+    /* ---------- order queues (L3OrderBookCore only) ---------- */
+    /* live qty / orders ahead of oid at its price and venue; false if unknown */
+    bool position(uint64_t oid,QueuePosition& out)           { return position_impl(imap_,oid,out); }
+    bool position(const std::string& oid,QueuePosition& out) { return position_impl(omap_,oid,out); }
+    /* make position(oid) O(1) from now until the order leaves its queue */
+    bool watch(uint64_t oid)             { return watch_impl(imap_,oid,true); }
+    bool watch(const std::string& oid)   { return watch_impl(omap_,oid,true); }
+    bool unwatch(uint64_t oid)           { return watch_impl(imap_,oid,false); }
+    bool unwatch(const std::string& oid) { return watch_impl(omap_,oid,false); }
+    /* FIFO of orders resting at (side, idx, venue), front first, or nullptr */
+    const OrderQueue* queue(Side s,int idx,Venue v) const {
+        static_assert(Queues::TRACKS_ORDERS, "queue() needs L3OrderBookCore");
+        return queues_.queue(s,idx,v);
+    }
+    const Queues& queues() const { return queues_; }
+
+private:
+    template<class Map,class Id>
+    bool position_impl(Map& map,const Id& oid,QueuePosition& out){
+        static_assert(Queues::TRACKS_ORDERS, "position() needs L3OrderBookCore");
+        meta_type* m = find_live(map,oid);
+        if(!m) return false;
+        out = queues_.position(*m);
+        return true;
+    }
+    template<class Map,class Id>
+    bool watch_impl(Map& map,const Id& oid,bool on){
+        static_assert(Queues::TRACKS_ORDERS, "watch() needs L3OrderBookCore");
+        meta_type* m = find_live(map,oid);
+        if(!m) return false;
+        if(on) queues_.watch(*m); else queues_.unwatch(*m);
+        return true;
+    }
+};
+
+using OrderBookCore   = BasicOrderBookCore<NoQueues>;
+using L3OrderBookCore = BasicOrderBookCore<FifoQueues>;
+
+/* ---------- NBBO conflation ---------- */
+/*
+ * Sink wrapper for one batch.  Executions pass straight through; NBBO
+ * moves are dropped and finish() emits, after them, one EV_NBBO per side
+ * whose best price or size differs from where it stood when the wrapper
+ * was built (bid first) -- the rule the bulk operations use.  The old_*
+ * fields and vqty describe that pre-batch best level, old_idx is NO_TICK
+ * if the side was empty; idx is NO_TICK (agg 0) if the batch emptied it.
+ * Unlike the full stream this also reports a best that worsened or
+ * vanished.
+ */
+template<class Sink,class Book = OrderBookCore>
+class ConflatingSink {
+    const Book& book_;
+    Sink&       out_;
+    Top         pre_[2];
+
+public:
+    ConflatingSink(const Book& book,Sink& out)
+        : book_(book), out_(out), pre_{book.top(Side::Bid), book.top(Side::Ask)} {}
+    void push_back(const BookEvent& ev){ if(ev.type!=EV_NBBO) out_.push_back(ev); }
+
+    void finish(){
+        for(Side s : {Side::Bid, Side::Ask}) report_top(book_.top(s), pre_[size_t(s)], out_);
+    }
+};
+
+template<class Queues>
+template<class Sink>
+void BasicOrderBookCore<Queues>::apply_conflated(const MsgRecord* recs,size_t n,Sink& out){
+    ConflatingSink<Sink,BasicOrderBookCore> c(*this, out);
+    apply(recs, n, c);
+    c.finish();
+}
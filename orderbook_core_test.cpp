@@ -0,0 +1,524 @@
+/*
+ * Native tests for the pybind11-free core.
+ *
+ *   g++ -std=c++17 -O1 -g orderbook_core_test.cpp -o orderbook_core_test
+ *   ./orderbook_core_test          (exit status 1 if any check failed)
+ *
+ * orderbook_test.py covers the Python reference and the pyorderbook
+ * bindings; this covers what only the native book has (L3 queues,
+ * snapshots, generation-retired orders).
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unistd.h>
+#include "feed_decoder.hpp"
+#include "replay.hpp"
+#include "shm_nbbo.hpp"
+#include "snapshot.hpp"
+#include "test_harness.hpp"
+
+using test::random_stream;
+
+template<class Book>
+static uint64_t resting_qty(const Book& b){ return b.total_qty(Side::Bid) + b.total_qty(Side::Ask); }
+
+template<class Book>
+static uint64_t order_qty(const Book& b){
+    uint64_t q = 0;
+    b.for_each_order([&](const auto&, const auto& m){ q += m.qty; });
+    return q;
+}
+
+template<class Book>
+static std::vector<uint64_t> int_oids(const Book& b){
+    std::vector<uint64_t> oids;
+    b.for_each_order([&](const auto& oid, const auto&){
+        if constexpr (std::is_same<std::decay_t<decltype(oid)>, uint64_t>::value) oids.push_back(oid);
+    });
+    return oids;
+}
+
+/* every open order as (oid, tick, qty, venue, side), sorted */
+template<class Book>
+static std::vector<std::tuple<std::string,int,uint32_t,uint8_t,Side>> orders(const Book& b){
+    std::vector<std::tuple<std::string,int,uint32_t,uint8_t,Side>> v;
+    b.for_each_order([&](const auto& oid, const auto& m){
+        if constexpr (std::is_same<std::decay_t<decltype(oid)>, uint64_t>::value)
+            v.emplace_back("#" + std::to_string(oid), m.idx, m.qty, m.vid, m.side);
+        else
+            v.emplace_back(oid, m.idx, m.qty, m.vid, m.side);
+    });
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+/* ---------- snapshots ---------- */
+/*
+ * Half way through a stream, just after a venue halt (its orders retired
+ * by generation, still in the maps): save, restore, save again.
+ */
+template<class Book>
+static void check_round_trip(){
+    std::vector<MsgRecord> recs = random_stream(1<<15);
+    const size_t cut = recs.size()/2;
+    Book book, restored;
+    std::vector<BookEvent> sink;
+    book.apply(recs.data(), cut, sink);
+    book.cancel_venue(Venue(3), sink);
+
+    std::vector<uint8_t> saved, again;
+    serialize(saved, book, cut);
+    SnapshotReader rd(saved.data(), saved.size());
+    CHECK(rd.seq() == cut && rd.books() == 1);
+    rd.next(restored);
+    CHECK(rd.done());
+    serialize(again, restored, cut);
+    CHECK(again == saved);
+
+    CHECK(order_qty(restored) == resting_qty(restored));      /* no retired order came back */
+    CHECK(resting_qty(restored) == resting_qty(book));
+    if constexpr (Book::queues_type::TRACKS_ORDERS)
+        for(uint64_t oid : int_oids(book)){
+            QueuePosition a{}, b{};
+            CHECK(book.position(oid, a) && restored.position(oid, b));
+            CHECK(a.qty_ahead == b.qty_ahead && a.orders_ahead == b.orders_ahead);
+        }
+
+    std::vector<BookEvent> want, got;
+    book.apply(recs.data()+cut, recs.size()-cut, want);
+    restored.apply(recs.data()+cut, recs.size()-cut, got);
+    CHECK(!want.empty() && test::same_events(want, got));
+    CHECK(orders(book) == orders(restored));
+    if constexpr (Book::queues_type::TRACKS_ORDERS){      /* L3 lists orders in arrival order */
+        serialize(saved, book, 0);
+        serialize(again, restored, 0);
+        CHECK(again == saved);
+    }
+}
+
+TEST(snapshot_round_trip)    { check_round_trip<OrderBookCore>(); }
+TEST(snapshot_round_trip_l3) { check_round_trip<L3OrderBookCore>(); }
+
+/* int and string oids queued at one (side, price, venue) keep their order */
+TEST(snapshot_mixed_oid_queue_l3){
+    L3OrderBookCore book, restored;
+    BookEvent ev;
+    book.add(std::string("s1"), Venue(0), Side::Bid, 1000, 5, ev);
+    book.add(uint64_t(7),       Venue(0), Side::Bid, 1000, 3, ev);
+    book.add(std::string("s2"), Venue(0), Side::Bid, 1000, 2, ev);
+    book.add(uint64_t(8),       Venue(0), Side::Bid, 1000, 4, ev);
+    std::vector<uint8_t> buf;
+    serialize(buf, book, 0);
+    SnapshotReader rd(buf.data(), buf.size());
+    rd.next(restored);
+    QueuePosition qp{};
+    CHECK(restored.position(uint64_t(7), qp) && qp.orders_ahead == 1 && qp.qty_ahead == 5);
+    CHECK(restored.position(std::string("s2"), qp) && qp.orders_ahead == 2 && qp.qty_ahead == 8);
+    CHECK(restored.position(uint64_t(8), qp) && qp.orders_ahead == 3 && qp.qty_ahead == 10);
+}
+
+TEST(snapshot_file_and_manager){
+    std::string path = "/tmp/orderbook_core_test." + std::to_string(::getpid()) + ".snap";
+    std::vector<MsgRecord> recs = random_stream(4096);
+
+    OrderBookCore book, loaded;
+    std::vector<BookEvent> sink;
+    book.apply(recs.data(), recs.size(), sink);
+    save_snapshot(path, book, 42);
+    CHECK(load_snapshot(path, loaded) == 42);
+    std::vector<uint8_t> a, b;
+    serialize(a, book, 42);
+    serialize(b, loaded, 42);
+    CHECK(a == b);
+
+    BookManager mgr, back;
+    mgr.open(3).apply(recs.data(), recs.size()/2, sink);
+    mgr.open(9).apply(recs.data(), recs.size(), sink);
+    back.open(5);                                         /* dropped by the load */
+    save_snapshot(path, mgr, 7);
+    CHECK(load_snapshot(path, back) == 7);
+    CHECK(back.size() == 2 && !back.find(5) && back.find(3) && back.find(9));
+    serialize(a, mgr, 7);
+    serialize(b, back, 7);
+    CHECK(a == b);
+    std::remove(path.c_str());
+}
+
+TEST(snapshot_rejects_corrupt_input){
+    OrderBookCore book;
+    BookEvent ev;
+    book.add(uint64_t(1), Venue(0), Side::Bid, 1000, 5, ev);
+    std::vector<uint8_t> buf;
+    serialize(buf, book, 0);
+    auto throws = [](std::vector<uint8_t> bytes){
+        try{ OrderBookCore b; SnapshotReader(bytes.data(), bytes.size()).next(b); }
+        catch(const std::runtime_error&){ return true; }
+        return false;
+    };
+    CHECK(throws(std::vector<uint8_t>(buf.begin(), buf.end()-1)));
+    std::vector<uint8_t> bad_magic = buf;
+    bad_magic[0] ^= 1;
+    CHECK(throws(bad_magic));
+}
+
+/* ---------- dense window ---------- */
+/* a window emptied while the best sits on the map moves to the best and
+   takes the sparse levels it now covers with it                         */
+TEST(window_follows_best_when_empty){
+    BidBook sb;
+    sb.add(100000, 0, 5);
+    sb.add(101000, 1, 3);                                    /* both beyond the window */
+    sb.add(101005, 2, 4);
+    sb.add( 90000, 1, 7);
+    CHECK(sb.origin() == 100000-HALF_W);
+    sb.remove(100000, 0, 5);
+    CHECK(sb.origin() == 101005-HALF_W && sb.best_idx() == 101005);
+    CHECK(sb.total_qty() == 14 && sb.level_count() == 3 && sb.depth_within(5) == 7);
+    CHECK(sb.next_worse(101005) == 101000 && sb.next_worse(101000) == 90000);
+    FillEstimate f = sb.fill(10);
+    CHECK(f.qty == 10 && f.worst == 90000 && f.notional == 4*101005 + 3*101000 + 3*90000);
+
+    AskBook ab;
+    ab.add(100000, 0, 5);
+    ab.remove(100000, 0, 5);
+    ab.add(99000, 3, 2);                                     /* empty window, new best off it */
+    CHECK(ab.origin() == 99000-HALF_W && ab.best_idx() == 99000 && ab.depth_within(0) == 2);
+}
+
+/* a market walking far beyond the window, quotes more than 30 ticks off
+   the mid cancelled: the window follows and every aggregate stays right */
+template<class Book>
+static void check_drift(){
+    struct Quote { int px; size_t vid; uint32_t qty; };
+    Book sb;
+    std::map<int,uint64_t> ref;
+    std::vector<Quote> live;
+    std::mt19937 rng(5);
+    int mid = 100000;
+    auto pull = [&](size_t k){
+        Quote o = live[k];
+        live[k] = live.back(); live.pop_back();
+        sb.remove(o.px, o.vid, o.qty);
+        if((ref[o.px] -= o.qty) == 0) ref.erase(o.px);
+    };
+    for(int step=0; step<20000; ++step){
+        mid += int(rng()%7) - 2;                                   /* about a tick a step */
+        if(live.size() < 20 || rng()%2){
+            Quote o{mid + int(rng()%41) - 20, rng()%NUM_VENUES, 1 + uint32_t(rng()%9)};
+            sb.add(o.px, o.vid, o.qty);
+            ref[o.px] += o.qty;
+            live.push_back(o);
+        }else pull(rng()%live.size());
+        for(size_t k=0; k<live.size();)
+            if(std::abs(live[k].px - mid) > 30) pull(k); else ++k;
+        int best = ref.empty() ? Book::EMPTY : Book::IS_BID ? ref.rbegin()->first : ref.begin()->first;
+        CHECK(sb.best_idx() == best && sb.level_count() == ref.size());
+    }
+    CHECK(mid - 100000 > 4*WINDOW);
+    CHECK(unsigned(sb.best_idx() - sb.origin()) < unsigned(WINDOW));
+    uint64_t total = 0, near = 0;
+    for(const auto& kv : ref){
+        total += kv.second;
+        if(std::abs(kv.first - sb.best_idx()) <= 10) near += kv.second;
+    }
+    CHECK(sb.total_qty() == total && sb.depth_within(10) == near);
+    CHECK(sb.fill(total).qty == total);
+}
+TEST(window_drift_bid) { check_drift<BidBook>(); }
+TEST(window_drift_ask) { check_drift<AskBook>(); }
+
+/* ---------- bulk removal ---------- */
+TEST(bulk_ops_report_qty_and_nbbo){
+    OrderBookCore b;
+    BookEvent ev;
+    std::vector<BookEvent> out;
+    b.add(uint64_t(1), Venue(0), Side::Bid, 100, 5, ev);
+    b.add(uint64_t(2), Venue(1), Side::Bid, 100, 3, ev);
+    b.add(uint64_t(3), Venue(1), Side::Bid,  99, 4, ev);
+    b.add(uint64_t(4), Venue(1), Side::Ask, 101, 2, ev);
+    CHECK(b.cancel_venue(Venue(2), out) == 0 && out.empty());
+    CHECK(b.cancel_venue(Venue(0), out) == 5 && out.size() == 1);      /* best size only */
+    CHECK(out[0].type == EV_NBBO && out[0].idx == 100 && out[0].agg == 3 &&
+          out[0].old_idx == 100 && out[0].old_agg == 8 && out[0].vqty[0] == 5);
+    out.clear();
+    CHECK(b.cancel_venue(Venue(1), out) == 9 && out.size() == 2);      /* bid, then ask */
+    CHECK(out[0].idx == NO_TICK && out[0].old_idx == 100 && out[1].idx == NO_TICK && out[1].old_idx == 101);
+    CHECK(b.empty(Side::Bid) && b.empty(Side::Ask));
+
+    out.clear();
+    b.add(uint64_t(5), Venue(0), Side::Bid, 100, 5, ev);
+    b.add(uint64_t(6), Venue(0), Side::Ask, 101, 6, ev);
+    CHECK(b.clear_side(Side::Ask, out) == 6 && out.size() == 1 && out[0].old_idx == 101);
+    CHECK(!b.empty(Side::Bid) && b.empty(Side::Ask));
+    b.add(uint64_t(7), Venue(3), Side::Ask, 102, 1, ev);
+    out.clear();
+    CHECK(b.cancel_all(out) == 6 && out.size() == 2 && b.empty(Side::Bid) && b.empty(Side::Ask));
+    out.clear();
+    CHECK(b.cancel_all(out) == 0 && out.empty());
+}
+
+/* ---------- NBBO conflation ---------- */
+/* one NBBO per side whose best price or size moved over the batch, after
+   the executions -- the same rule as the bulk operations               */
+TEST(conflated_batch_reports_price_or_size){
+    auto rec = [](uint8_t type, uint64_t oid, Side s, int32_t px, uint32_t qty){
+        MsgRecord r{};
+        r.msg_type = type; r.oid = oid; r.venue = 0;
+        r.side = uint8_t(s); r.price_ticks = px; r.qty = qty;
+        return r;
+    };
+    OrderBookCore b;
+    std::vector<BookEvent> out;
+    MsgRecord setup[] = {rec(MSG_ADD, 1, Side::Bid, 100, 5), rec(MSG_ADD, 2, Side::Bid, 99, 4),
+                         rec(MSG_ADD, 3, Side::Ask, 101, 2)};
+    b.apply(setup, 3, out);
+    out.clear();
+
+    MsgRecord grow[] = {rec(MSG_ADD, 4, Side::Bid, 100, 3), rec(MSG_EXECUTE, 3, Side::Ask, 0, 2)};
+    b.apply_conflated(grow, 2, out);                                    /* bid size only, ask emptied */
+    CHECK(out.size() == 3 && out[0].type == EV_EXEC);
+    CHECK(out[1].type == EV_NBBO && out[1].idx == 100 && out[1].agg == 8 &&
+          out[1].old_idx == 100 && out[1].old_agg == 5 && out[1].vqty[0] == 5);
+    CHECK(out[2].type == EV_NBBO && out[2].idx == NO_TICK && out[2].agg == 0 && out[2].old_idx == 101);
+    out.clear();
+
+    MsgRecord worsen[] = {rec(MSG_CANCEL, 1, Side::Bid, 0, 0), rec(MSG_CANCEL, 4, Side::Bid, 0, 0)};
+    b.apply_conflated(worsen, 2, out);
+    CHECK(out.size() == 1 && out[0].idx == 99 && out[0].agg == 4 && out[0].old_idx == 100 && out[0].old_agg == 8);
+    out.clear();
+
+    MsgRecord there_and_back[] = {rec(MSG_ADD, 5, Side::Bid, 100, 1), rec(MSG_CANCEL, 5, Side::Bid, 0, 0)};
+    b.apply_conflated(there_and_back, 2, out);
+    CHECK(out.empty());
+}
+
+/*
+ * Each bulk call against cancelling the same orders one by one: the two
+ * books must look the same afterwards and keep producing the same events.
+ */
+template<class Book>
+static void check_bulk_matches_cancels(){
+    std::vector<MsgRecord> recs = random_stream(1<<14, 3);
+    const size_t step = recs.size()/8;
+    Book bulk, each;
+    std::vector<BookEvent> eb, ee;
+    std::mt19937 rng(11);
+    for(size_t at = 0; at + step <= recs.size(); at += step){
+        bulk.apply(recs.data()+at, step, eb);
+        each.apply(recs.data()+at, step, ee);
+        CHECK(test::same_events(eb, ee));
+        eb.clear(); ee.clear();
+
+        int op = int(rng() % 3);
+        Venue v = Venue(rng() % NUM_VENUES);
+        Side  s = rng() % 2 ? Side::Ask : Side::Bid;
+        std::vector<uint64_t> victims;
+        each.for_each_order([&](const auto& oid, const auto& m){
+            if constexpr (std::is_same<std::decay_t<decltype(oid)>, uint64_t>::value)
+                if(op==2 || (op==0 ? m.vid==uint8_t(v) : m.side==s)) victims.push_back(oid);
+        });
+        uint64_t before = resting_qty(bulk);
+        uint64_t gone = op==0 ? bulk.cancel_venue(v, eb) : op==1 ? bulk.clear_side(s, eb) : bulk.cancel_all(eb);
+        for(uint64_t oid : victims) each.cancel(oid);
+        CHECK(gone == before - resting_qty(bulk));
+        CHECK(eb.size() <= 2);
+        eb.clear();
+
+        CHECK(orders(bulk) == orders(each));
+        for(Side sd : {Side::Bid, Side::Ask}){
+            CHECK(bulk.best_idx(sd) == each.best_idx(sd));
+            CHECK(bulk.total_qty(sd) == each.total_qty(sd) && bulk.level_count(sd) == each.level_count(sd));
+        }
+        if constexpr (Book::queues_type::TRACKS_ORDERS)
+            for(uint64_t oid : int_oids(each)){
+                QueuePosition a{}, b{};
+                CHECK(bulk.position(oid, a) && each.position(oid, b));
+                CHECK(a.qty_ahead == b.qty_ahead && a.orders_ahead == b.orders_ahead);
+            }
+    }
+}
+
+TEST(bulk_matches_cancels)    { check_bulk_matches_cancels<OrderBookCore>(); }
+TEST(bulk_matches_cancels_l3) { check_bulk_matches_cancels<L3OrderBookCore>(); }
+
+/*
+ * A bulk call retires orders by bumping their (side, venue) generation;
+ * the entries stay in the order map until looked up or swept, and (L3)
+ * keep pointers to queue nodes that were already dropped.
+ */
+template<class Book>
+static void check_retired_orders_unknown(){
+    constexpr bool L3 = Book::queues_type::TRACKS_ORDERS;
+    Book b;
+    BookEvent ev;
+    std::vector<BookEvent> out;
+    QueuePosition qp{};
+    b.add(uint64_t(1), Venue(0), Side::Bid, 1000, 5, ev);
+    b.add(uint64_t(2), Venue(0), Side::Ask, 1001, 5, ev);
+    b.add(uint64_t(3), Venue(1), Side::Bid, 1000, 7, ev);
+    b.add(uint64_t(5), Venue(0), Side::Bid, 1000, 2, ev);
+    b.add(std::string("s"), Venue(0), Side::Ask, 1001, 1, ev);
+    if constexpr (L3) b.watch(uint64_t(1));
+    CHECK(b.cancel_venue(Venue(0), out) == 13 && resting_qty(b) == 7);
+
+    if constexpr (L3){
+        CHECK(!b.position(uint64_t(2), qp));
+        CHECK(!b.watch(uint64_t(1)));
+        CHECK(!b.position(std::string("s"), qp));
+    }
+    b.cancel(uint64_t(1));
+    b.cancel(std::string("s"));
+    CHECK(resting_qty(b) == 7);
+    CHECK(!b.execute(uint64_t(5), 1, ev) && resting_qty(b) == 7);
+    b.replace(uint64_t(4), uint64_t(2), Venue(0), Side::Ask, 1002, 3, ev);   /* acts as an add */
+    CHECK(resting_qty(b) == 10 && b.best_idx(Side::Ask) == 1002);
+
+    b.add(uint64_t(1), Venue(0), Side::Bid, 1000, 4, ev);                   /* same oid, same venue */
+    if constexpr (L3) CHECK(b.position(uint64_t(1), qp) && qp.orders_ahead == 0 && qp.qty_ahead == 0);
+    CHECK(b.execute(uint64_t(1), 1, ev) && resting_qty(b) == 13);
+    b.cancel(uint64_t(1));
+    CHECK(resting_qty(b) == 10);
+    CHECK(order_qty(b) == resting_qty(b));
+}
+
+TEST(retired_orders_unknown)    { check_retired_orders_unknown<OrderBookCore>(); }
+TEST(retired_orders_unknown_l3) { check_retired_orders_unknown<L3OrderBookCore>(); }
+
+/* an insert that would grow the map sweeps retired entries first */
+template<class Book>
+static void check_retired_swept_before_growth(){
+    Book b;
+    BookEvent ev;
+    std::vector<BookEvent> out;
+    size_t slots = b.pool_stats().int_order_slots, n = slots*3/4;
+    for(uint64_t oid = 1; oid <= n; ++oid) b.add(oid, Venue(0), Side::Bid, 1000 + int(oid % 5), 1, ev);
+    b.cancel_venue(Venue(0), out);
+    for(uint64_t oid = n+1; oid <= 2*n; ++oid) b.add(oid, Venue(1), Side::Bid, 1000, 1, ev);
+    CHECK(b.pool_stats().int_order_slots == slots);
+    CHECK(resting_qty(b) == n && order_qty(b) == n);
+    for(uint64_t oid = 1; oid <= n; ++oid) CHECK(!b.execute(oid, 1, ev));
+}
+
+TEST(retired_swept_before_growth)    { check_retired_swept_before_growth<OrderBookCore>(); }
+TEST(retired_swept_before_growth_l3) { check_retired_swept_before_growth<L3OrderBookCore>(); }
+
+/* 65536 halts bring the counter back to a retired order's generation */
+template<class Book>
+static void check_generation_wrap(){
+    Book b;
+    BookEvent ev;
+    std::vector<BookEvent> out;
+    QueuePosition qp{};
+    b.add(uint64_t(1), Venue(0), Side::Bid, 1000, 5, ev);
+    b.add(uint64_t(9), Venue(0), Side::Ask, 1001, 5, ev);
+    for(int i = 0; i < 65536; ++i) b.cancel_venue(Venue(0), out);
+    b.add(uint64_t(2), Venue(0), Side::Bid, 1000, 3, ev);
+    b.cancel(uint64_t(1));
+    CHECK(resting_qty(b) == 3 && !b.execute(uint64_t(1), 1, ev) && !b.execute(uint64_t(9), 1, ev));
+    if constexpr (Book::queues_type::TRACKS_ORDERS) CHECK(!b.position(uint64_t(1), qp));
+    CHECK(b.execute(uint64_t(2), 1, ev) && resting_qty(b) == 2);
+
+    for(int i = 0; i < 70000; ++i) b.cancel_venue(Venue(0), out);         /* past a second wrap */
+    CHECK(resting_qty(b) == 0 && order_qty(b) == 0 && !b.execute(uint64_t(2), 1, ev));
+    b.add(uint64_t(2), Venue(0), Side::Bid, 1000, 3, ev);
+    CHECK(b.execute(uint64_t(2), 3, ev) && resting_qty(b) == 0);
+}
+
+TEST(generation_wrap)    { check_generation_wrap<OrderBookCore>(); }
+TEST(generation_wrap_l3) { check_generation_wrap<L3OrderBookCore>(); }
+
+/* ---------- capture replay ---------- */
+/* chunks that split messages, some on a page boundary, decode the same
+   as the whole capture applied at once                               */
+TEST(replay_chunks_match_direct_apply){
+    std::string path = "/tmp/orderbook_core_test." + std::to_string(::getpid()) + ".cap";
+    std::vector<MsgRecord> recs = random_stream(1<<14);
+    std::vector<uint8_t> buf(recs.size() * wire::MAX_MSG);
+    size_t len = 0;
+    for(const auto& r : recs) len += wire::encode(r, &buf[len]);
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    CHECK(f && std::fwrite(buf.data(), 1, len, f) == len);
+    std::fclose(f);
+
+    OrderBookCore direct;
+    std::vector<BookEvent> want;
+    direct.apply(recs.data(), recs.size(), want);
+    const size_t page = size_t(::sysconf(_SC_PAGESIZE));
+    for(size_t chunk : {page, 3*page + 5, size_t(1)<<20}){
+        OrderBookCore book;
+        std::vector<BookEvent> got;
+        size_t chunks = 0;
+        ReplayStats st = replay(path, book, got, [&]{ ++chunks; }, chunk);
+        CHECK(test::same_events(want, got));
+        CHECK(st.messages == recs.size() && st.bytes == len && chunks >= len/chunk);
+    }
+    std::remove(path.c_str());
+}
+
+/* ---------- record validation ---------- */
+/* venue and side bytes are range-checked, on every path into apply_one */
+TEST(apply_rejects_bad_venue_and_side){
+    auto rejected = [](uint8_t venue, uint8_t side, uint8_t type){
+        MsgRecord r{};
+        r.msg_type = type; r.oid = 1; r.old_oid = 2;
+        r.venue = venue; r.side = side; r.price_ticks = 1000; r.qty = 5;
+        OrderBookCore book;
+        std::vector<BookEvent> out;
+        try{ book.apply(&r, 1, out); }
+        catch(const std::out_of_range&){ return book.empty(Side::Bid) && book.empty(Side::Ask); }
+        return false;
+    };
+    for(uint8_t type : {uint8_t(MSG_ADD), uint8_t(MSG_REPLACE)}){
+        CHECK(rejected(NUM_VENUES, uint8_t(Side::Bid), type));
+        CHECK(rejected(0, 2, type));
+        CHECK(rejected(0, 'A', type));
+        CHECK(!rejected(0, uint8_t(Side::Ask), type));
+    }
+
+    MsgRecord r{};
+    r.msg_type = MSG_ADD; r.oid = 1; r.venue = 0; r.side = 7; r.price_ticks = 1000; r.qty = 5;
+    uint8_t buf[wire::MAX_MSG];
+    size_t len = wire::encode(r, buf);
+    OrderBookCore book;
+    std::vector<BookEvent> out;
+    bool threw = false;
+    try{ wire::decode(buf, len, book, out); }
+    catch(const std::out_of_range&){ threw = true; }
+    CHECK(threw && book.empty(Side::Ask));
+}
+
+/* ---------- shared NBBO table ---------- */
+/* a batch naming an instrument beyond the table is refused whole */
+TEST(apply_published_rejects_whole_batch){
+    const std::string name = "orderbook_core_test." + std::to_string(::getpid());
+    NbboShmWriter w(name, 4, 16);
+    NbboShmReader rd(name, true);
+    BookManager mgr;
+    std::vector<RoutedEvent> out;
+    auto add = [](uint32_t inst, uint64_t oid, int32_t px){
+        RoutedMsg m{};
+        m.instrument = inst; m.msg_type = MSG_ADD; m.oid = oid;
+        m.venue = 0; m.side = uint8_t(Side::Bid); m.price_ticks = px; m.qty = 5;
+        return m;
+    };
+    RoutedMsg bad[] = {add(1, 1, 1000), add(1, 2, 1001), add(9, 3, 1000)};
+    bool threw = false;
+    try{ apply_published(mgr, bad, 3, out, w); }
+    catch(const std::out_of_range&){ threw = true; }
+    CHECK(threw);
+    CHECK(out.empty() && !mgr.find(1));
+    TopOfBook t;
+    CHECK(rd.read(1, t) && t.bid_ticks == NO_TICK && t.updates == 0);
+
+    RoutedMsg good[] = {add(1, 1, 1000), add(1, 2, 1001)};     /* the first add moves no best */
+    apply_published(mgr, good, 2, out, w);
+    CHECK(out.size() == 1 && mgr.find(1) && mgr.find(1)->best_idx(Side::Bid) == 1001);
+    CHECK(rd.read(1, t) && t.bid_ticks == 1001 && t.bid_qty == 5);
+    NbboShmWriter::unlink(name);
+}
+
+int main(){ return test::run_tests(); }
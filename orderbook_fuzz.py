@@ -0,0 +1,288 @@
+"""
+Differential fuzzer for the book implementations.
+
+Random, self-consistent message streams are fed through the orderbook.py
+reference and through pyorderbook (per-message API and on_batch_array);
+every NBBO-improvement and execution payload, and the best bid/ask after
+each message, must agree.  Each implementation is then timed on the
+same stream.
+
+    python3 orderbook_fuzz.py [--seeds 50] [--messages 20000] [--spread 40]
+                              [--far 0.02] [--venues 14] [--mix 35,25,30,10]
+
+Payloads are compared in a canonical form: prices in ticks, venues as
+the sorted one-letter codes.  Without a built pyorderbook the reference
+is still checked against a brute-force best bid/ask and timed alone.
+"""
+import argparse
+import random
+import sys
+import time
+
+import orderbook as ref
+
+try:
+    import pyorderbook
+except ImportError:
+    pyorderbook = None
+
+VENUE_CODES = "CIBMNXHEYJZQWA"          # same order as ref.VENUES
+TICK        = ref.TICK_SIZE
+MID         = 5000                      # $50.00 in ticks; far bids stay > 0
+
+
+# ---------------- stream generation ----------------
+def generate(rng, n, mix, spread, per_level, venues, far):
+    """
+    Messages as ("add", oid, vid, side, ticks, qty), ("cancel", oid),
+    ("replace", new_oid, old_oid, vid, side, ticks, qty) and
+    ("execute", oid, qty).  Only live orders are cancelled, replaced or
+    executed; adds are favoured while the book is thin.  Half the
+    replaces keep their oid, and half of those their venue, side and
+    price too (a qty change in place).
+    """
+    live, qty_of, quote_of = [], {}, {}
+    target = 2 * spread * per_level
+    out, next_oid = [], 1
+    kinds = ("add", "cancel", "replace", "execute")
+
+    def quote():
+        side = b'BID' if rng.random() < 0.5 else b'ASK'
+        off  = rng.randrange(spread)
+        if rng.random() < far:                       # outside the dense window
+            off += rng.randrange(600, 3000)
+        ticks = MID - 1 - off if side == b'BID' else MID + 1 + off
+        return rng.randrange(venues), side, ticks, rng.randint(1, 50)
+
+    while len(out) < n:
+        kind = rng.choices(kinds, mix)[0]
+        if not live or (kind != "add" and len(live) < target // 2 and rng.random() < 0.5):
+            kind = "add"
+        if kind == "add":
+            oid = str(next_oid); next_oid += 1
+            vid, side, ticks, qty = quote()
+            live.append(oid); qty_of[oid] = qty; quote_of[oid] = (vid, side, ticks)
+            out.append(("add", oid, vid, side, ticks, qty))
+            continue
+        k = rng.randrange(len(live))
+        oid = live[k]
+        if kind == "cancel":
+            live[k] = live[-1]; live.pop(); del qty_of[oid], quote_of[oid]
+            out.append(("cancel", oid))
+        elif kind == "replace":
+            vid, side, ticks, qty = quote()
+            if rng.random() < 0.5:
+                new = oid
+                if rng.random() < 0.5:
+                    vid, side, ticks = quote_of[oid]
+            else:
+                new = str(next_oid); next_oid += 1
+            live[k] = new
+            del qty_of[oid], quote_of[oid]
+            qty_of[new] = qty; quote_of[new] = (vid, side, ticks)
+            out.append(("replace", new, oid, vid, side, ticks, qty))
+        else:
+            take = rng.randint(1, qty_of[oid])
+            qty_of[oid] -= take
+            if not qty_of[oid]:
+                live[k] = live[-1]; live.pop(); del qty_of[oid], quote_of[oid]
+            out.append(("execute", oid, take))
+    return out
+
+
+# ---------------- canonical payloads ----------------
+def ticks(px):
+    return None if px is None else int(round(px / TICK))
+
+def codes_from_names(names):
+    return "".join(sorted(VENUE_CODES[ref.VENUE_MAP[v]] for v in names))
+
+def codes_from_str(s):
+    return "".join(sorted(s))
+
+def canon_ref(res):
+    if res is None:
+        return None
+    if len(res) == 4:
+        px, rem, per_venue, names = res
+        return ("exec", ticks(px), rem, tuple(per_venue), codes_from_names(names))
+    new_px, new_sz, old_px, old_sz, names = res
+    return ("nbbo", ticks(new_px), new_sz, ticks(old_px), old_sz, codes_from_names(names))
+
+def canon_native(res):
+    if res is None:
+        return None
+    if len(res) == 4:
+        px, rem, per_venue, vs = res
+        return ("exec", ticks(px), rem, tuple(per_venue), codes_from_str(vs))
+    new_px, new_sz, old_px, old_sz, vs = res
+    return ("nbbo", ticks(new_px), new_sz, ticks(old_px), old_sz, codes_from_str(vs))
+
+
+# ---------------- adapters ----------------
+class RefBook:
+    name = "orderbook.py"
+
+    def __init__(self):
+        self.book = ref.OrderBook()
+
+    def apply(self, m):
+        b = self.book
+        if m[0] == "add":
+            _, oid, vid, side, t, q = m
+            return canon_ref(b.on_add(oid, ref.VENUES[vid], side, t * TICK, q))
+        if m[0] == "cancel":
+            b.on_cancel(m[1]); return None
+        if m[0] == "replace":
+            _, new, old, vid, side, t, q = m
+            return canon_ref(b.on_replace(new, old, ref.VENUES[vid], side, t * TICK, q))
+        return canon_ref(b.on_execute(m[1], m[2]))
+
+    def best(self):
+        return ticks(self.book.best_bid()), ticks(self.book.best_ask())
+
+    def brute_best(self):
+        """best bid/ask straight from the level dicts"""
+        bids, asks = self.book.levels[b'BID'], self.book.levels[b'ASK']
+        return (max(bids) if bids else None), (min(asks) if asks else None)
+
+
+class NativeBook:
+    name = "pyorderbook"
+
+    def __init__(self):
+        self.book = pyorderbook.OrderBook(TICK)
+
+    def apply(self, m):
+        b = self.book
+        if m[0] == "add":
+            _, oid, vid, side, t, q = m
+            return canon_native(b.on_add(oid, VENUE_CODES[vid], side, t * TICK, q))
+        if m[0] == "cancel":
+            b.on_cancel(m[1]); return None
+        if m[0] == "replace":
+            _, new, old, vid, side, t, q = m
+            return canon_native(b.on_replace(new, old, VENUE_CODES[vid], side, t * TICK, q))
+        return canon_native(b.on_execute(m[1], m[2]))
+
+    def best(self):
+        return ticks(self.book.best_bid()), ticks(self.book.best_ask())
+
+
+def to_records(msgs):
+    """stream → msg_dtype array for on_batch_array (oids are numeric strings)"""
+    import numpy as np
+    recs = np.zeros(len(msgs), dtype=pyorderbook.msg_dtype)
+    side_id = {b'BID': pyorderbook.SIDE_BID, b'ASK': pyorderbook.SIDE_ASK}
+    for i, m in enumerate(msgs):
+        r = recs[i]
+        r["msg_type"] = {"add": pyorderbook.MSG_ADD, "cancel": pyorderbook.MSG_CANCEL,
+                         "replace": pyorderbook.MSG_REPLACE,
+                         "execute": pyorderbook.MSG_EXECUTE}[m[0]]
+        if m[0] == "add":
+            _, oid, vid, side, t, q = m
+            r["oid"], r["venue"], r["side"], r["price_ticks"], r["qty"] = int(oid), vid, side_id[side], t, q
+        elif m[0] == "cancel":
+            r["oid"] = int(m[1])
+        elif m[0] == "replace":
+            _, new, old, vid, side, t, q = m
+            r["oid"], r["old_oid"] = int(new), int(old)
+            r["venue"], r["side"], r["price_ticks"], r["qty"] = vid, side_id[side], t, q
+        else:
+            r["oid"], r["qty"] = int(m[1]), m[2]
+    return recs
+
+
+# ---------------- differential run ----------------
+class Mismatch(Exception):
+    pass
+
+def check(msgs):
+    """run one stream through every implementation; raise on the first divergence"""
+    r = RefBook()
+    n = NativeBook() if pyorderbook else None
+    expected = []
+    for i, m in enumerate(msgs):
+        got_r = r.apply(m)
+        if got_r is not None:
+            expected.append(got_r)
+        bb, ba = r.best()
+        if (bb, ba) != r.brute_best():
+            raise Mismatch(f"msg {i} {m}: reference best {(bb, ba)} != levels {r.brute_best()}")
+        if n is None:
+            continue
+        got_n = n.apply(m)
+        if got_n != got_r:
+            raise Mismatch(f"msg {i} {m}: payload\n  reference {got_r}\n  native    {got_n}")
+        if n.best() != (bb, ba):
+            raise Mismatch(f"msg {i} {m}: best\n  reference {(bb, ba)}\n  native    {n.best()}")
+    if n is not None:
+        batch = [canon_native(e) for e in
+                 pyorderbook.OrderBook(TICK).on_batch_array(to_records(msgs))]
+        if batch != expected:
+            first = next(i for i, (a, b) in enumerate(zip(expected + [None], batch + [None]))
+                         if a != b)
+            raise Mismatch(f"on_batch_array event {first}:\n  reference "
+                           f"{expected[first:first+1]}\n  batch     {batch[first:first+1]}")
+
+
+# ---------------- throughput ----------------
+def throughput(msgs):
+    rows = []
+    def timed(name, fn):
+        t0 = time.perf_counter(); fn(); dt = time.perf_counter() - t0
+        rows.append((name, len(msgs) / dt, dt * 1e9 / len(msgs)))
+    def per_message(cls):
+        def run():
+            b = cls()
+            for m in msgs:
+                b.apply(m)
+        return run
+    timed(RefBook.name, per_message(RefBook))
+    if pyorderbook:
+        timed(NativeBook.name, per_message(NativeBook))
+        recs = to_records(msgs)
+        timed("pyorderbook batch", lambda: pyorderbook.OrderBook(TICK).on_batch_array(recs))
+    return rows
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    ap.add_argument("--seeds",     type=int,   default=50)
+    ap.add_argument("--first-seed", type=int,  default=1)
+    ap.add_argument("--messages",  type=int,   default=20000)
+    ap.add_argument("--spread",    type=int,   default=40)
+    ap.add_argument("--per-level", type=int,   default=4)
+    ap.add_argument("--venues",    type=int,   default=len(VENUE_CODES))
+    ap.add_argument("--far",       type=float, default=0.02,
+                    help="fraction of quotes placed outside the dense window")
+    ap.add_argument("--mix",       default="35,25,30,10",
+                    help="add,cancel,replace,execute weights")
+    a = ap.parse_args(argv)
+    mix = [int(x) for x in a.mix.split(",")]
+
+    if pyorderbook is None:
+        print("pyorderbook not importable: checking the reference alone")
+    elif pyorderbook.VENUE_CODES != VENUE_CODES:
+        sys.exit("VENUE_CODES differ between orderbook_fuzz.py and pyorderbook")
+
+    msgs = None
+    for seed in range(a.first_seed, a.first_seed + a.seeds):
+        msgs = generate(random.Random(seed), a.messages, mix, a.spread,
+                        a.per_level, a.venues, a.far)
+        try:
+            check(msgs)
+        except Mismatch as e:
+            print(f"seed {seed}: {e}")
+            return 1
+    verdict = "all implementations agree" if pyorderbook else "reference consistent (native not checked)"
+    print(f"{a.seeds} seeds x {a.messages} messages: {verdict}")
+
+    print(f"{'implementation':<20}{'msgs/s':>14}{'ns/msg':>10}")
+    for name, rate, ns in throughput(msgs):
+        print(f"{name:<20}{rate:>14,.0f}{ns:>10.0f}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
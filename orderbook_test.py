@@ -5,7 +5,8 @@ Assumptions
 -----------
 * OrderBook, PriceLevel, p2i/i2p helpers are in the same directory
   (or pip-installable package path).
-* 'on_execute' is a no-op for now (per user note).
+* 'on_execute' returns the execution payload (exec_price, level_remaining,
+  per_venue_qty, venues).
 
 This is **not** a full unit-suite—just smoke checks that the
 best-price cursor and NBBO-improvement tuple behave the same
@@ -14,6 +15,11 @@ as the original SortedList design.
 
 from orderbook import OrderBook, VENUES, i2p
 
+try:
+    import pyorderbook          # native book; its tests skip when not built
+except ImportError:
+    pyorderbook = None
+
 def assert_eq(a, b, msg=""):
     if a != b:
         raise AssertionError(f"{msg}  {a!r} != {b!r}")
@@ -59,6 +65,41 @@ def test_replace_atomic():
     # ensure best now 2.60
     assert_eq(ob.best_bid(), 2.60)
 
+def test_replace_old_level_after_replace():
+    """old_* describe the previous best level as it stands after the replace"""
+    ob = OrderBook()
+    ob.on_add("b1", "CBOE", b'BID', 2.50, 100)
+    ob.on_add("b2", "ISE",  b'BID', 2.50, 40)
+    ob.on_add("b3", "BOX",  b'BID', 2.45, 10)
+
+    # one of two orders leaves the best level: old_* without it
+    ret = ob.on_replace("b4", "b2", "ISE", b'BID', 2.55, 40)
+    assert_eq(ret, (i2p(255), 40, i2p(250), 100, ["CBOE"]), "old level keeps b1 only")
+    # the only order at the best moves up: old level reported empty
+    ret = ob.on_replace("b5", "b4", "ISE", b'BID', 2.60, 40)
+    assert_eq(ret, (i2p(260), 40, i2p(255), 0, []), "old level emptied")
+    # an order behind the best jumps it: old level untouched
+    ret = ob.on_replace("b6", "b3", "BOX", b'BID', 2.65, 10)
+    assert_eq(ret, (i2p(265), 10, i2p(260), 40, ["ISE"]), "old level untouched")
+    # a replace that worsens its price reports nothing
+    assert_eq(ob.on_replace("b7", "b6", "BOX", b'BID', 2.40, 10), None, "worse replace")
+    assert_eq(ob.best_bid(), i2p(260), "best after worse replace")
+
+def test_replace_same_oid():
+    ob = OrderBook()
+    ob.on_add("x", "CBOE", b'BID', 2.50, 100)
+    ob.on_add("y", "ISE",  b'BID', 2.45, 10)
+
+    # same oid, same level, qty down: the level holds the new qty only
+    assert_eq(ob.on_replace("x", "x", "CBOE", b'BID', 2.50, 60), None, "qty-down replace")
+    assert_eq(ob.levels[b'BID'][250].agg_qty, 60, "level qty after qty-down replace")
+    # same oid to a better price: old level emptied, the oid follows the order
+    ret = ob.on_replace("x", "x", "CBOE", b'BID', 2.55, 30)
+    assert_eq(ret, (i2p(255), 30, i2p(250), 0, []), "same-oid improvement")
+    assert_eq(250 in ob.levels[b'BID'], False, "old level left behind")
+    ob.on_cancel("x")
+    assert_eq((ob.best_bid(), sorted(ob.order_map)), (i2p(245), ["y"]), "cancel after same-oid replace")
+
 def test_heap_fallback():
     """
     Add a price 30 dollars away so it's outside the ±$5 window.
@@ -94,10 +135,106 @@ def test_heap_fallback2():
     print(ob.best_bid())     
     assert_eq(ob.best_bid(), -32.50, "best should fall back to near price")
 
+# ---------------- native bulk operations (pyorderbook) ----------------
+def native(fn):
+    """mark a test that needs the pyorderbook extension"""
+    fn.native = True
+    return fn
+
+def nbbo(ev):
+    """NBBO tuple with prices rounded to cents and venues as a sorted string"""
+    new_px, new_sz, old_px, old_sz, venues = ev
+    r = lambda px: None if px is None else round(px, 2)
+    return r(new_px), new_sz, r(old_px), old_sz, "".join(sorted(venues))
+
+@native
+def test_native_cancel_venue():
+    ob = pyorderbook.OrderBook(0.01)
+    ob.on_add(1, "C", b'BID', 2.50, 5)
+    ob.on_add(2, "I", b'BID', 2.50, 3)
+    ob.on_add(3, "I", b'BID', 2.49, 4)
+    ob.on_add(4, "I", b'ASK', 2.51, 2)
+
+    assert_eq(ob.cancel_venue("B"), [], "halting an idle venue reports nothing")
+    evs = ob.cancel_venue("C")                       # best bid keeps its price, loses size
+    assert_eq([nbbo(e) for e in evs], [(2.50, 3, 2.50, 8, "CI")], "cancel_venue C")
+    evs = ob.cancel_venue("I")                       # both sides emptied: bid first
+    assert_eq([nbbo(e) for e in evs], [(None, 0, 2.50, 3, "I"), (None, 0, 2.51, 2, "I")],
+              "cancel_venue I")
+    assert_eq((ob.best_bid(), ob.best_ask()), (None, None), "book empty after both halts")
+
+@native
+def test_native_halted_orders_unknown():
+    ob = pyorderbook.OrderBook(0.01)
+    ob.on_add(1, "C", b'BID', 2.50, 5)
+    ob.on_add("s1", "C", b'ASK', 2.52, 5)
+    ob.on_add(2, "I", b'BID', 2.49, 7)
+    ob.cancel_venue("C")
+
+    assert_eq(ob.on_execute(1, 1), None, "execute of a halted order")
+    assert_eq(ob.on_execute("s1", 1), None, "execute of a halted string-oid order")
+    ob.on_cancel(1)                                  # unknown: no effect
+    assert_eq(round(ob.best_bid(), 2), 2.49, "cancel of a halted order moved the book")
+    ob.on_replace(3, 1, "C", b'ASK', 2.55, 4)        # old oid gone: acts as an add
+    assert_eq(round(ob.best_ask(), 2), 2.55, "replace of a halted order should add")
+
+    ob.on_add(1, "C", b'BID', 2.50, 5)               # same oid, same venue: live again
+    px, remaining, per_venue, venues = ob.on_execute(1, 2)
+    assert_eq((round(px, 2), remaining, venues), (2.50, 3, "C"), "re-added order not live")
+
+@native
+def test_native_clear_side_and_cancel_all():
+    ob = pyorderbook.OrderBook(0.01)
+    ob.on_add(1, "C", b'BID', 2.50, 5)
+    ob.on_add(2, "I", b'ASK', 2.51, 6)
+    ob.on_add("s3", "B", b'ASK', 2.53, 1)
+
+    evs = ob.clear_side(b'ASK')
+    assert_eq([nbbo(e) for e in evs], [(None, 0, 2.51, 6, "I")], "clear_side ASK")
+    assert_eq((round(ob.best_bid(), 2), ob.best_ask()), (2.50, None), "bids survive clear_side")
+    assert_eq(ob.on_execute(2, 1), None, "cleared ask still executable")
+
+    ob.on_add(4, "I", b'ASK', 2.52, 2)
+    evs = ob.cancel_all()
+    assert_eq([nbbo(e) for e in evs], [(None, 0, 2.50, 5, "C"), (None, 0, 2.52, 2, "I")],
+              "cancel_all")
+    assert_eq(ob.cancel_all(), [], "cancel_all on an empty book")
+    assert_eq((ob.best_bid(), ob.best_ask()), (None, None), "book empty after cancel_all")
+
+@native
+def test_native_replace_semantics():
+    """the cases of test_replace_old_level_after_replace / _same_oid"""
+    ob = pyorderbook.OrderBook(0.01)
+    ob.on_add(1, "C", b'BID', 2.50, 100)
+    ob.on_add(2, "I", b'BID', 2.50, 40)
+    ob.on_add(3, "B", b'BID', 2.45, 10)
+    assert_eq(nbbo(ob.on_replace(4, 2, "I", b'BID', 2.55, 40)), (2.55, 40, 2.50, 100, "C"),
+              "old level keeps 1 only")
+    assert_eq(nbbo(ob.on_replace(5, 4, "I", b'BID', 2.60, 40)), (2.60, 40, 2.55, 0, ""),
+              "old level emptied")
+    assert_eq(nbbo(ob.on_replace(6, 3, "B", b'BID', 2.65, 10)), (2.65, 10, 2.60, 40, "I"),
+              "old level untouched")
+    assert_eq(ob.on_replace(7, 6, "B", b'BID', 2.40, 10), None, "worse replace")
+
+    ob = pyorderbook.OrderBook(0.01)
+    ob.on_add(1, "C", b'BID', 2.50, 100)
+    ob.on_add(2, "I", b'BID', 2.45, 10)
+    assert_eq(ob.on_replace(1, 1, "C", b'BID', 2.50, 60), None, "qty-down replace")
+    assert_eq(nbbo(ob.on_replace(1, 1, "C", b'BID', 2.55, 30)), (2.55, 30, 2.50, 0, ""),
+              "same-oid improvement")
+    ob.on_cancel(1)
+    assert_eq(round(ob.best_bid(), 2), 2.45, "cancel after same-oid replace")
+
 def run_all():
-    for fn in globals().values():
+    skipped = 0
+    for fn in list(globals().values()):
         if callable(fn) and fn.__name__.startswith("test_"):
+            if getattr(fn, "native", False) and pyorderbook is None:
+                skipped += 1
+                continue
             fn()
+    if skipped:
+        print(f"skipped {skipped} native tests (pyorderbook not importable)")
     print("All tests passed ✔")
 
 if __name__ == "__main__":
@@ -0,0 +1,380 @@
+#pragma once
+/*
+ * Single-core coroutine pipeline around a book (C++20):
+ *
+ *   receive → decode → apply → publish
+ *
+ * Every stage is a coroutine on one Scheduler and stages hand work over
+ * bounded Channels: a full channel suspends its producer (backpressure),
+ * an empty one its consumer, and the thread itself never blocks -- a
+ * source with nothing to read just yields to the other stages.
+ *
+ * receive fills pooled buffers from the Source; decode parses MsgRecords
+ * straight out of those buffers (only a message split across two reads
+ * is copied) and returns each buffer once parsed; apply runs a batch
+ * through Book::apply; publish hands the resulting events to the Sink.
+ *
+ * Batch size adapts the way BatchedBookDriver.batch_size is tuned by
+ * hand: decode closes a batch at its target size, or early once it has
+ * drained all received input, and the target halves while the apply
+ * queue stays empty (quiet: latency) and doubles while it is half full
+ * or more (burst: throughput), within [min_batch, max_batch].
+ *
+ * The rest of the tree is C++17; include this header from C++20
+ * translation units only.
+ */
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "pipeline.hpp needs C++20 coroutines (-std=c++20)"
+#endif
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <cerrno>
+#include <unistd.h>
+#include "feed_decoder.hpp"
+#include "spsc_ring.hpp"
+
+namespace pipeline {
+
+/* ---------- Scheduler ---------- */
+class Scheduler {
+    std::deque<std::coroutine_handle<>> ready_;
+public:
+    void post(std::coroutine_handle<> h){ ready_.push_back(h); }
+    bool idle() const { return ready_.empty(); }
+
+    /* resume the oldest ready coroutine; false if none */
+    bool run_one(){
+        if(ready_.empty()) return false;
+        auto h = ready_.front();
+        ready_.pop_front();
+        h.resume();
+        return true;
+    }
+
+    /* co_await sched.yield(): go to the back of the ready queue */
+    auto yield(){
+        struct Awaiter {
+            Scheduler& s;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h){ s.post(h); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+};
+
+/* ---------- Task ---------- */
+/* a stage coroutine; starts suspended, keeps its exception for the owner */
+class Task {
+public:
+    struct promise_type {
+        std::exception_ptr error;
+        Task get_return_object(){ return Task(handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(handle h) : h_(h) {}
+    Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task& operator=(Task&& o) noexcept { if(this != &o){ reset(); h_ = std::exchange(o.h_, {}); } return *this; }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task(){ reset(); }
+
+    void start(Scheduler& s){ s.post(h_); }
+    bool done() const { return !h_ || h_.done(); }
+    std::exception_ptr error() const { return h_ ? h_.promise().error : nullptr; }
+
+private:
+    handle h_{};
+    void reset(){ if(h_){ h_.destroy(); h_ = {}; } }
+};
+
+/* ---------- Channel ---------- */
+/* bounded queue between two coroutines of one Scheduler */
+template<class T>
+class Channel {
+    Scheduler&              s_;
+    std::deque<T>           q_;
+    size_t                  cap_;
+    bool                    closed_{false};
+    std::coroutine_handle<> push_waiter_{};
+    std::coroutine_handle<> pop_waiter_{};
+
+    static void wake(Scheduler& s,std::coroutine_handle<>& h){
+        if(h){ s.post(h); h = {}; }
+    }
+
+public:
+    Channel(Scheduler& s,size_t capacity) : s_(s), cap_(std::max<size_t>(capacity, 1)) {}
+
+    size_t size()     const { return q_.size(); }
+    size_t capacity() const { return cap_; }
+    bool   full()     const { return q_.size() >= cap_; }
+
+    /* co_await ch.push(v): suspends while the channel is full */
+    auto push(T v){
+        struct Awaiter {
+            Channel& c;
+            T        v;
+            bool await_ready() const noexcept { return !c.full(); }
+            void await_suspend(std::coroutine_handle<> h){ c.push_waiter_ = h; }
+            void await_resume(){
+                c.q_.push_back(std::move(v));
+                wake(c.s_, c.pop_waiter_);
+            }
+        };
+        return Awaiter{*this, std::move(v)};
+    }
+
+    /* co_await ch.pop(): next item, or nullopt once closed and drained */
+    auto pop(){
+        struct Awaiter {
+            Channel& c;
+            bool await_ready() const noexcept { return !c.q_.empty() || c.closed_; }
+            void await_suspend(std::coroutine_handle<> h){ c.pop_waiter_ = h; }
+            std::optional<T> await_resume(){
+                if(c.q_.empty()) return std::nullopt;
+                T v = std::move(c.q_.front());
+                c.q_.pop_front();
+                wake(c.s_, c.push_waiter_);
+                return v;
+            }
+        };
+        return Awaiter{*this};
+    }
+
+    /* push without suspending; false if full */
+    bool try_push(T v){
+        if(full()) return false;
+        q_.push_back(std::move(v));
+        wake(s_, pop_waiter_);
+        return true;
+    }
+
+    /* no more pushes; a waiting consumer sees the end */
+    void close(){ closed_ = true; wake(s_, pop_waiter_); }
+};
+
+/* ---------- sources ---------- */
+/*
+ * A Source has  size_t read(uint8_t* buf, size_t cap)  returning the
+ * bytes it could read without blocking (0 = nothing right now) and
+ * bool eof() const.
+ */
+
+/* non-blocking file descriptor (socket, pipe) */
+class FdSource {
+    int  fd_;
+    bool eof_{false};
+public:
+    explicit FdSource(int fd) : fd_(fd) {}
+    size_t read(uint8_t* buf,size_t cap){
+        ssize_t n = ::read(fd_, buf, cap);
+        if(n > 0) return size_t(n);
+        if(n == 0){ eof_ = true; return 0; }
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        throw std::runtime_error("FdSource: read failed");
+    }
+    bool eof() const { return eof_; }
+};
+
+/* an in-memory capture, at most max_read bytes per read */
+class MemorySource {
+    const uint8_t* p_;
+    size_t         left_;
+    size_t         max_read_;
+public:
+    MemorySource(const uint8_t* data,size_t len,size_t max_read = size_t(64)<<10)
+        : p_(data), left_(len), max_read_(std::max<size_t>(max_read, 1)) {}
+    size_t read(uint8_t* buf,size_t cap){
+        size_t n = std::min({cap, left_, max_read_});
+        std::memcpy(buf, p_, n);
+        p_ += n; left_ -= n;
+        return n;
+    }
+    bool eof() const { return left_ == 0; }
+};
+
+/* ---------- Pipeline ---------- */
+struct PipelineConfig {
+    size_t recv_buffers = 8;                 /* receive buffers in flight   */
+    size_t recv_bytes   = size_t(64)<<10;    /* bytes per receive buffer    */
+    size_t queue_depth  = 8;                 /* batches between stages      */
+    size_t min_batch    = 1;
+    size_t max_batch    = 4096;
+};
+
+struct PipelineStats {
+    uint64_t bytes{0};
+    uint64_t messages{0};
+    uint64_t batches{0};
+    uint64_t events{0};
+    uint64_t idle_polls{0};                  /* reads that found nothing    */
+    size_t   batch_target{0};                /* decode's target at the end  */
+    double   mean_batch() const { return batches ? double(messages)/double(batches) : 0.0; }
+};
+
+/* Sink as for apply(); if it has flush() that runs after every batch */
+template<class Book,class Source,class Sink>
+class Pipeline {
+    struct Chunk { size_t buf; size_t len; };
+
+    Book&          book_;
+    Source&        src_;
+    Sink&          sink_;
+    PipelineConfig cfg_;
+    PipelineStats  st_;
+    bool           ran_{false};
+    Scheduler      sched_;
+
+    std::vector<std::vector<uint8_t>>     bufs_;
+    Channel<size_t>                       free_bufs_;
+    Channel<Chunk>                        chunks_;
+    Channel<std::vector<MsgRecord>>       batches_;
+    Channel<std::vector<BookEvent>>       events_;
+    std::vector<std::vector<MsgRecord>>   spare_recs_;   /* recycled batches */
+    std::vector<std::vector<BookEvent>>   spare_evs_;
+
+    template<class V>
+    static V take_spare(std::vector<V>& spare){
+        if(spare.empty()) return V{};
+        V v = std::move(spare.back());
+        spare.pop_back();
+        v.clear();
+        return v;
+    }
+
+    Task receive(){
+        while(true){
+            std::optional<size_t> b = co_await free_bufs_.pop();   /* waits for decode */
+            size_t n;
+            while(!(n = src_.read(bufs_[*b].data(), bufs_[*b].size()))){
+                if(src_.eof()){ chunks_.close(); co_return; }
+                ++st_.idle_polls;
+                if(sched_.idle()) cpu_relax();
+                co_await sched_.yield();
+            }
+            st_.bytes += n;
+            co_await chunks_.push(Chunk{*b, n});
+        }
+    }
+
+    Task decode(){
+        uint8_t carry[wire::MAX_MSG];
+        size_t  carry_len = 0;
+        size_t  target    = cfg_.min_batch;
+        std::vector<MsgRecord> batch = take_spare(spare_recs_);
+
+        auto retarget = [&]{                      /* on every batch handed to apply */
+            size_t depth = batches_.size();
+            if(depth == 0)                          target = std::max(cfg_.min_batch, target/2);
+            else if(2*depth >= batches_.capacity()) target = std::min(cfg_.max_batch, target*2);
+            ++st_.batches;
+        };
+
+        while(std::optional<Chunk> c = co_await chunks_.pop()){
+            const uint8_t* p = bufs_[c->buf].data();
+            size_t len = c->len, off = 0;
+            if(carry_len){                                  /* finish the split message */
+                size_t need = wire::SIZES.len[carry[0]] - carry_len;
+                size_t k = std::min(need, len);
+                std::memcpy(carry + carry_len, p, k);
+                carry_len += k; off = k;
+                if(k == need){ batch.push_back(wire::parse(carry)); carry_len = 0; }
+            }
+            while(off < len){
+                size_t n = wire::SIZES.len[p[off]];
+                if(!n) throw std::runtime_error("unknown message type in stream");
+                if(off + n > len){                          /* split: keep the head */
+                    carry_len = len - off;
+                    std::memcpy(carry, p + off, carry_len);
+                    break;
+                }
+                batch.push_back(wire::parse(p + off));
+                off += n;
+                if(batch.size() >= target){
+                    retarget();
+                    co_await batches_.push(std::move(batch));
+                    batch = take_spare(spare_recs_);
+                }
+            }
+            co_await free_bufs_.push(c->buf);
+            if(!batch.empty() && chunks_.size() == 0){      /* caught up with input */
+                retarget();
+                co_await batches_.push(std::move(batch));
+                batch = take_spare(spare_recs_);
+            }
+        }
+        if(carry_len) throw std::runtime_error("stream ends inside a message");
+        if(!batch.empty()){ retarget(); co_await batches_.push(std::move(batch)); }
+        st_.batch_target = target;
+        batches_.close();
+    }
+
+    Task apply(){
+        while(std::optional<std::vector<MsgRecord>> b = co_await batches_.pop()){
+            std::vector<BookEvent> evs = take_spare(spare_evs_);
+            book_.apply(b->data(), b->size(), evs);
+            st_.messages += b->size();
+            spare_recs_.push_back(std::move(*b));
+            if(evs.empty()){ spare_evs_.push_back(std::move(evs)); continue; }
+            co_await events_.push(std::move(evs));
+        }
+        events_.close();
+    }
+
+    Task publish(){
+        while(std::optional<std::vector<BookEvent>> e = co_await events_.pop()){
+            for(const BookEvent& ev : *e) sink_.push_back(ev);
+            if constexpr (requires { sink_.flush(); }) sink_.flush();
+            st_.events += e->size();
+            spare_evs_.push_back(std::move(*e));
+        }
+    }
+
+public:
+    Pipeline(Book& book,Source& src,Sink& sink,PipelineConfig cfg = {})
+        : book_(book), src_(src), sink_(sink), cfg_(cfg),
+          bufs_(std::max<size_t>(cfg.recv_buffers, 1), std::vector<uint8_t>(std::max<size_t>(cfg.recv_bytes, 1))),
+          free_bufs_(sched_, bufs_.size()),
+          chunks_(sched_, bufs_.size()),
+          batches_(sched_, cfg.queue_depth),
+          events_(sched_, cfg.queue_depth)
+    {
+        if(cfg_.min_batch < 1 || cfg_.max_batch < cfg_.min_batch)
+            throw std::invalid_argument("need 1 <= min_batch <= max_batch");
+    }
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    /* run every stage until the source ends and all events are published;
+       the first exception from any stage stops the pipeline and is rethrown.
+       A Pipeline runs once. */
+    PipelineStats run(){
+        if(ran_) throw std::logic_error("Pipeline::run called twice");
+        ran_ = true;
+        for(size_t i=0;i<bufs_.size();++i) free_bufs_.try_push(i);
+        Task stages[] = {receive(), decode(), apply(), publish()};
+        for(Task& t : stages) t.start(sched_);
+        while(sched_.run_one())
+            for(Task& t : stages)
+                if(auto e = t.error()) std::rethrow_exception(e);
+        for(Task& t : stages)
+            if(!t.done()) throw std::logic_error("pipeline stalled with a stage suspended");
+        return st_;
+    }
+    const PipelineStats& stats() const { return st_; }
+};
+
+} // namespace pipeline
@@ -0,0 +1,158 @@
+/*
+ * Tests for the coroutine pipeline (pipeline.hpp needs C++20).
+ *
+ *   g++ -std=c++20 -O1 -g pipeline_test.cpp -o pipeline_test
+ *   ./pipeline_test                (exit status 1 if any check failed)
+ */
+#include <random>
+#include <stdexcept>
+#include "pipeline.hpp"
+#include "test_harness.hpp"
+
+using namespace pipeline;
+using test::random_stream;
+
+static std::vector<uint8_t> encode_all(const std::vector<MsgRecord>& recs){
+    std::vector<uint8_t> buf(recs.size() * wire::MAX_MSG);
+    size_t len = 0;
+    for(const auto& r : recs) len += wire::encode(r, &buf[len]);
+    buf.resize(len);
+    return buf;
+}
+
+/* events OrderBookCore::apply gives for the records directly */
+static std::vector<BookEvent> direct(const std::vector<MsgRecord>& recs){
+    OrderBookCore book;
+    std::vector<BookEvent> out;
+    book.apply(recs.data(), recs.size(), out);
+    return out;
+}
+
+/* MemorySource that finds nothing on some reads, like a quiet socket */
+struct FlakySource {
+    MemorySource mem;
+    std::mt19937 rng{3};
+    size_t read(uint8_t* buf,size_t cap){ return rng()%3 ? mem.read(buf, cap) : 0; }
+    bool   eof() const { return mem.eof(); }
+};
+
+/* sink with flush(): the pipeline calls it once per published batch */
+struct FlushingSink {
+    std::vector<BookEvent> events;
+    size_t flushes{0};
+    void push_back(const BookEvent& ev){ events.push_back(ev); }
+    void flush(){ ++flushes; }
+};
+
+/* ---------- results match direct apply ---------- */
+/* small reads split most messages across receive buffers; tiny receive
+   buffers split them across several                                  */
+TEST(split_reads_match_direct_apply){
+    std::vector<MsgRecord> recs = random_stream(1<<15);
+    std::vector<uint8_t> wire_buf = encode_all(recs);
+    std::vector<BookEvent> want = direct(recs);
+    for(size_t max_read : {size_t(1), size_t(7), size_t(100), size_t(4096), size_t(1)<<20})
+        for(size_t recv_bytes : {size_t(wire::MAX_MSG)/2, size_t(64)<<10}){
+            OrderBookCore book;
+            std::vector<BookEvent> got;
+            MemorySource src(wire_buf.data(), wire_buf.size(), max_read);
+            PipelineConfig cfg;
+            cfg.recv_bytes  = recv_bytes;
+            cfg.queue_depth = 4;
+            PipelineStats st = Pipeline(book, src, got, cfg).run();
+            CHECK(test::same_events(want, got));
+            CHECK(st.messages == recs.size() && st.bytes == wire_buf.size() && st.events == got.size());
+        }
+}
+
+TEST(idle_source_and_flushing_sink){
+    std::vector<MsgRecord> recs = random_stream(1<<14);
+    std::vector<uint8_t> wire_buf = encode_all(recs);
+    OrderBookCore book;
+    FlushingSink sink;
+    FlakySource src{MemorySource(wire_buf.data(), wire_buf.size(), 333)};
+    PipelineStats st = Pipeline(book, src, sink).run();
+    CHECK(test::same_events(direct(recs), sink.events));
+    CHECK(st.idle_polls > 0);
+    CHECK(sink.flushes > 0 && sink.flushes <= st.batches);
+}
+
+TEST(l3_book){
+    std::vector<MsgRecord> recs = random_stream(1<<14);
+    std::vector<uint8_t> wire_buf = encode_all(recs);
+    L3OrderBookCore book;
+    std::vector<BookEvent> got;
+    MemorySource src(wire_buf.data(), wire_buf.size(), 999);
+    Pipeline(book, src, got).run();
+    CHECK(test::same_events(direct(recs), got));
+}
+
+/* ---------- adaptive batch target ---------- */
+/* input a few bytes at a time never backs up: every batch is closed
+   early and the target stays at min_batch                            */
+TEST(trickle_keeps_min_batch){
+    std::vector<MsgRecord> recs = random_stream(1<<14);
+    std::vector<uint8_t> wire_buf = encode_all(recs);
+    for(size_t min_batch : {size_t(1), size_t(8)}){
+        OrderBookCore book;
+        std::vector<BookEvent> got;
+        MemorySource src(wire_buf.data(), wire_buf.size(), 7);
+        PipelineConfig cfg;
+        cfg.min_batch = min_batch;
+        PipelineStats st = Pipeline(book, src, got, cfg).run();
+        CHECK(st.batch_target == min_batch);
+        CHECK(st.mean_batch() < 4.0);
+    }
+}
+
+/* whole receive buffers of backlog keep the apply queue filling up, so
+   the target doubles up to max_batch and batches get large            */
+TEST(backlog_grows_to_max_batch){
+    std::vector<MsgRecord> recs = random_stream(1<<17);
+    std::vector<uint8_t> wire_buf = encode_all(recs);
+    for(size_t max_batch : {size_t(256), size_t(4096)}){
+        OrderBookCore book;
+        std::vector<BookEvent> got;
+        PipelineConfig cfg;
+        cfg.max_batch = max_batch;
+        MemorySource src(wire_buf.data(), wire_buf.size(), cfg.recv_bytes);
+        PipelineStats st = Pipeline(book, src, got, cfg).run();
+        CHECK(st.batch_target == max_batch);
+        CHECK(st.mean_batch() > double(max_batch)/4);
+        CHECK(test::same_events(direct(recs), got));
+    }
+}
+
+/* ---------- errors ---------- */
+template<class F>
+static bool throws(F&& f){
+    try{ f(); }
+    catch(const std::exception&){ return true; }
+    return false;
+}
+
+TEST(bad_input_and_misuse){
+    std::vector<uint8_t> wire_buf = encode_all(random_stream(256));
+    std::vector<uint8_t> unknown(wire_buf.begin(), wire_buf.begin() + 200);
+    size_t off = 0;
+    while(off + wire::SIZES.len[unknown[off]] <= unknown.size()) off += wire::SIZES.len[unknown[off]];
+    unknown.resize(off);
+    unknown.push_back('Z');                                /* no such message type */
+    std::vector<uint8_t> cut(wire_buf.begin(), wire_buf.begin() + off + 1);   /* ends mid-message */
+
+    OrderBookCore book;
+    std::vector<BookEvent> got;
+    CHECK(throws([&]{ MemorySource s(unknown.data(), unknown.size(), 10); Pipeline(book, s, got).run(); }));
+    CHECK(throws([&]{ MemorySource s(cut.data(), cut.size()); Pipeline(book, s, got).run(); }));
+
+    PipelineConfig bad;
+    bad.min_batch = 8;
+    bad.max_batch = 4;
+    MemorySource src(wire_buf.data(), wire_buf.size());
+    CHECK(throws([&]{ Pipeline(book, src, got, bad); }));
+    Pipeline once(book, src, got);
+    once.run();
+    CHECK(throws([&]{ once.run(); }));
+}
+
+int main(){ return test::run_tests(); }
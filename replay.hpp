@@ -0,0 +1,167 @@
+#pragma once
+/*
+ * Replay of capture files in the wire format (feed_decoder.hpp).  The
+ * file is mmapped read-only with sequential hints and decoded in large
+ * chunks; pages behind the cursor are dropped so RSS stays flat over a
+ * day-long file.  Events go to any sink; EventFileSink writes packed
+ * EventRecords that numpy can read back with event_dtype.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "feed_decoder.hpp"
+
+/* ---------- EventRecord  (on-disk event row) ---------- */
+#pragma pack(push,1)
+struct EventRecord {
+    uint8_t  event_type;        /* EventType                        */
+    int32_t  price_ticks;       /* new best / exec tick             */
+    uint32_t agg;
+    int32_t  old_price_ticks;   /* NBBO only                        */
+    uint32_t old_agg;
+    uint16_t venue_mask;
+    uint32_t venue_qty[NUM_VENUES];
+};
+#pragma pack(pop)
+
+inline EventRecord to_record(const BookEvent& ev){
+    EventRecord r;
+    r.event_type      = ev.type;
+    r.price_ticks     = ev.idx;
+    r.agg             = ev.agg;
+    r.old_price_ticks = ev.old_idx;
+    r.old_agg         = ev.old_agg;
+    r.venue_mask      = ev.vmask;
+    lanes::copy_out(ev.vqty, r.venue_qty);
+    return r;
+}
+
+/* ---------- MappedFile ---------- */
+class MappedFile {
+    int         fd_{-1};
+    size_t      size_{0};
+    const uint8_t* data_{nullptr};
+public:
+    explicit MappedFile(const std::string& path){
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if(fd_ < 0) throw std::runtime_error("cannot open " + path);
+        struct stat st;
+        if(::fstat(fd_, &st) != 0){ ::close(fd_); throw std::runtime_error("cannot stat " + path); }
+        size_ = size_t(st.st_size);
+        if(size_){
+            void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if(p == MAP_FAILED){ ::close(fd_); throw std::runtime_error("cannot mmap " + path); }
+            data_ = static_cast<const uint8_t*>(p);
+            ::madvise(p, size_, MADV_SEQUENTIAL);
+        }
+    }
+    ~MappedFile(){
+        if(data_) ::munmap(const_cast<uint8_t*>(data_), size_);
+        if(fd_ >= 0) ::close(fd_);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    /* hint the kernel about [off, off+len) */
+    void advise(size_t off,size_t len,int advice) const {
+        size_t page = size_t(::sysconf(_SC_PAGESIZE));
+        size_t lo = off & ~(page-1);
+        size_t hi = std::min(size_, off+len);
+        if(hi > lo) ::madvise(const_cast<uint8_t*>(data_)+lo, hi-lo, advice);
+    }
+    /* drop the pages of [off, end) that lie wholly before the page holding
+       end, which keeps the partial message the next chunk starts with    */
+    void release(size_t off,size_t end) const {
+        size_t page = size_t(::sysconf(_SC_PAGESIZE));
+        size_t lo = off & ~(page-1);
+        size_t hi = end & ~(page-1);
+        if(hi > lo) ::madvise(const_cast<uint8_t*>(data_)+lo, hi-lo, MADV_DONTNEED);
+    }
+};
+
+/* ---------- sinks ---------- */
+/* buffered writer of EventRecords */
+class EventFileSink {
+    std::FILE* f_;
+    std::vector<EventRecord> buf_;
+public:
+    explicit EventFileSink(const std::string& path, size_t buffer_events = 1<<16)
+        : f_(std::fopen(path.c_str(), "wb")) {
+        if(!f_) throw std::runtime_error("cannot create " + path);
+        buf_.reserve(buffer_events);
+    }
+    ~EventFileSink(){ flush(); std::fclose(f_); }
+    EventFileSink(const EventFileSink&) = delete;
+    EventFileSink& operator=(const EventFileSink&) = delete;
+
+    void push_back(const BookEvent& ev){
+        buf_.push_back(to_record(ev));
+        if(buf_.size() == buf_.capacity()) flush();
+    }
+    void flush(){
+        if(buf_.empty()) return;
+        if(std::fwrite(buf_.data(), sizeof(EventRecord), buf_.size(), f_) != buf_.size())
+            throw std::runtime_error("short write on event file");
+        buf_.clear();
+    }
+};
+
+/* ---------- replay ---------- */
+struct ReplayStats {
+    uint64_t messages{0};
+    uint64_t events{0};
+    uint64_t bytes{0};
+    double   seconds{0};
+    double msgs_per_sec() const { return seconds > 0 ? messages/seconds : 0; }
+};
+
+/* counts events on their way to the real sink */
+template<class Sink>
+struct CountingSink {
+    Sink&     inner;
+    uint64_t& n;
+    void push_back(const BookEvent& ev){ ++n; inner.push_back(ev); }
+};
+
+/* on_chunk() is called after each chunk, e.g. to hand events to Python */
+template<class Book,class Sink,class OnChunk>
+ReplayStats replay(const std::string& path,Book& book,Sink& sink,
+                   OnChunk&& on_chunk,size_t chunk_bytes = size_t(64)<<20){
+    MappedFile file(path);
+    ReplayStats st;
+    CountingSink<Sink> counted{sink, st.events};
+    const uint8_t* data = file.data();
+    size_t size = file.size(), off = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    while(off < size){
+        size_t len = std::min(chunk_bytes, size-off);
+        file.advise(off+len, chunk_bytes, MADV_WILLNEED);
+        wire::DecodeResult r = wire::decode(data+off, len, book, counted);
+        if(!r.bytes){
+            if(off+len == size) throw std::runtime_error("truncated message at end of capture");
+            len = std::min(size-off, wire::MAX_MSG);        /* chunk split a message */
+            r = wire::decode(data+off, len, book, counted);
+        }
+        file.release(off, off+r.bytes);
+        off          += r.bytes;
+        st.messages  += r.messages;
+        on_chunk();
+    }
+    st.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+    st.bytes   = size;
+    return st;
+}
+template<class Book,class Sink>
+ReplayStats replay(const std::string& path,Book& book,Sink& sink,
+                   size_t chunk_bytes = size_t(64)<<20){
+    return replay(path, book, sink, []{}, chunk_bytes);
+}
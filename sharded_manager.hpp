@@ -0,0 +1,148 @@
+#pragma once
+/*
+ * ShardedBookManager: instruments are split across N worker threads by
+ * instrument % N.  Each worker owns a BookManager, drains its own SPSC
+ * ring of RoutedMsgs and writes RoutedEvents to its own output ring, so
+ * no book is ever touched by two threads and SideBook needs no locks.
+ *
+ * Threading contract: submit() from one producer thread, poll() from one
+ * consumer thread (they may be the same thread).  Events of a single
+ * instrument come out in order; events of different shards interleave.
+ */
+#include <vector>
+#include "book_manager.hpp"
+#include "spsc_ring.hpp"
+
+class ShardedBookManager {
+    static constexpr size_t WORKER_BATCH = 256;
+
+    struct Shard {
+        BookManager           books;
+        SpscRing<RoutedMsg>   in;
+        SpscRing<RoutedEvent> out;
+        alignas(CACHE_LINE) std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> errors{0};
+        alignas(CACHE_LINE) uint64_t submitted{0};      /* producer only */
+        std::thread           thread;
+
+        Shard(size_t in_cap,size_t out_cap): in(in_cap), out(out_cap) {}
+    };
+
+    /* worker-side sink: spins while the output ring is full */
+    struct RingSink {
+        SpscRing<RoutedEvent>&   ring;
+        const std::atomic<bool>& stop;
+        void push_back(const RoutedEvent& e){
+            while(!ring.try_push(e)){
+                if(stop.load(std::memory_order_relaxed)) return;
+                cpu_relax();
+            }
+        }
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool> stop_{false};
+    size_t next_poll_{0};
+
+    void run(Shard& sh){
+        RoutedMsg batch[WORKER_BATCH];
+        RingSink  sink{sh.out, stop_};
+        unsigned  idle = 0;
+        while(!stop_.load(std::memory_order_relaxed)){
+            size_t n = sh.in.pop_batch(batch, WORKER_BATCH);
+            if(!n){
+                if(++idle < 1024) cpu_relax();
+                else std::this_thread::yield();
+                continue;
+            }
+            idle = 0;
+            for(size_t i=0;i<n;++i){
+                try{
+                    sh.books.apply(&batch[i], 1, sink);
+                }catch(const std::exception&){
+                    sh.errors.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            sh.processed.fetch_add(n, std::memory_order_release);
+        }
+    }
+
+public:
+    /* cpus[i] pins shard i's worker; shards without an entry float */
+    explicit ShardedBookManager(size_t n_shards,
+                                const std::vector<int>& cpus = {},
+                                size_t ring_capacity = size_t(1)<<16){
+        if(!n_shards) throw std::invalid_argument("need at least one shard");
+        for(size_t i=0;i<n_shards;++i)
+            shards_.emplace_back(new Shard(ring_capacity, ring_capacity));
+        for(size_t i=0;i<n_shards;++i){
+            Shard& sh = *shards_[i];
+            sh.thread = std::thread([this,&sh]{ run(sh); });
+            if(i < cpus.size()) pin_thread(sh.thread, cpus[i]);
+        }
+    }
+    ~ShardedBookManager(){
+        stop_.store(true, std::memory_order_relaxed);
+        for(auto& sh : shards_) if(sh->thread.joinable()) sh->thread.join();
+    }
+    ShardedBookManager(const ShardedBookManager&) = delete;
+    ShardedBookManager& operator=(const ShardedBookManager&) = delete;
+
+    size_t shards() const { return shards_.size(); }
+    size_t shard_of(uint32_t instrument) const { return instrument % shards_.size(); }
+
+    /* ---------- producer ---------- */
+    /* route msgs in order; stops at the first full ring and returns how
+       many were accepted, so the caller can retry from there           */
+    size_t submit(const RoutedMsg* msgs,size_t n){
+        for(size_t i=0;i<n;++i){
+            Shard& sh = *shards_[shard_of(msgs[i].instrument)];
+            if(!sh.in.try_push(msgs[i])) return i;
+            ++sh.submitted;
+        }
+        return n;
+    }
+    /* every submitted message has been applied (events may still be queued) */
+    bool caught_up() const {
+        for(const auto& sh : shards_)
+            if(sh->processed.load(std::memory_order_acquire) != sh->submitted) return false;
+        return true;
+    }
+
+    /* ---------- consumer ---------- */
+    /* drain up to max events, round-robin across shards */
+    size_t poll(RoutedEvent* out,size_t max){
+        size_t got = 0;
+        for(size_t k=0; k<shards_.size() && got<max; ++k){
+            Shard& sh = *shards_[(next_poll_+k) % shards_.size()];
+            got += sh.out.pop_batch(out+got, max-got);
+        }
+        next_poll_ = (next_poll_+1) % shards_.size();
+        return got;
+    }
+
+    /* messages rejected by the books (bad msg_type / venue) so far */
+    uint64_t errors() const {
+        uint64_t e = 0;
+        for(const auto& sh : shards_) e += sh->errors.load(std::memory_order_relaxed);
+        return e;
+    }
+
+    /* push a whole batch and collect its events; Sink needs
+       push_back(RoutedEvent).  Drains while submitting so a full output
+       ring can never stall the workers.                                */
+    template<class Sink>
+    void apply(const RoutedMsg* msgs,size_t n,Sink& out){
+        RoutedEvent buf[WORKER_BATCH];
+        size_t done = 0;
+        for(;;){
+            done += submit(msgs+done, n-done);
+            bool finished = done==n && caught_up();
+            size_t got;
+            while((got = poll(buf, WORKER_BATCH)))
+                for(size_t i=0;i<got;++i) out.push_back(buf[i]);
+            if(finished) return;
+            cpu_relax();
+        }
+    }
+};
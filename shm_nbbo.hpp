@@ -0,0 +1,359 @@
+#pragma once
+/*
+ * Shared-memory NBBO publication for other processes on the host.  The
+ * book process creates a POSIX shared-memory segment holding
+ *
+ *   - a top-of-book table indexed by instrument id.  Each row is a
+ *     seqlock: the writer makes seq odd, stores the row, makes it even
+ *     again; a reader copies the row and retries unless it saw the same
+ *     even seq before and after the copy;
+ *   - optionally a broadcast ring of NBBO changes (one record per side
+ *     whose best price, size or venue set moved).  Every slot carries its
+ *     own sequence stamp, so any number of readers follow at their own
+ *     pace and find out when the writer has lapped them.
+ *
+ * Readers map the segment read-only: they never write shared state, so
+ * they cannot slow the writer or each other.  Prices are in ticks
+ * (NO_TICK for an empty side).  A writer that restarts unlinks the old
+ * segment and creates a fresh one; readers have to reopen it.
+ */
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "book_manager.hpp"
+#include "spsc_ring.hpp"
+
+namespace shm_detail {
+
+constexpr uint64_t MAGIC   = 0x4f42424e42425348ull;    /* "HSBBNBBO" */
+constexpr uint32_t VERSION = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<uint32_t>::is_always_lock_free &&
+              std::atomic<int32_t>::is_always_lock_free,
+              "atomics in shared memory must be lock-free");
+
+inline std::string shm_name(const std::string& name){
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+struct alignas(CACHE_LINE) Header {
+    std::atomic<uint64_t> magic;           /* written last by the creator */
+    uint32_t version;
+    uint32_t instruments;                  /* rows in the table           */
+    uint64_t ring_slots;                   /* power of two, 0 = no ring   */
+    alignas(CACHE_LINE) std::atomic<uint64_t> ring_head;   /* records ever written */
+};
+
+struct alignas(CACHE_LINE) Row {
+    std::atomic<uint32_t> seq;
+    std::atomic<int32_t>  bid_ticks, ask_ticks;
+    std::atomic<uint32_t> bid_qty, ask_qty;
+    std::atomic<uint32_t> masks;           /* bid mask | ask mask << 16   */
+    std::atomic<uint64_t> updates;         /* rows written so far         */
+};
+
+struct alignas(32) Slot {
+    std::atomic<uint64_t> stamp;           /* 2*pos+1 writing, 2*pos+2 done */
+    std::atomic<uint32_t> instrument;
+    std::atomic<uint32_t> side_mask;       /* side | venue mask << 8      */
+    std::atomic<int32_t>  price_ticks;
+    std::atomic<uint32_t> qty;
+};
+
+/* ring slots: n rounded up to a power of two, 0 stays 0 */
+inline uint64_t ring_slots_for(size_t n){
+    uint64_t s = 1;
+    while(s < n) s <<= 1;
+    return n ? s : 0;
+}
+
+inline size_t segment_size(uint32_t instruments,uint64_t ring_slots){
+    return sizeof(Header) + size_t(instruments)*sizeof(Row) + size_t(ring_slots)*sizeof(Slot);
+}
+
+/* mmapped segment, owned for its lifetime */
+class Segment {
+    void*  base_{nullptr};
+    size_t size_{0};
+public:
+    Segment(const std::string& name,size_t size,bool create){
+        std::string n = shm_name(name);
+        int fd;
+        if(create){
+            ::shm_unlink(n.c_str());                         /* never truncate under readers */
+            fd = ::shm_open(n.c_str(), O_CREAT|O_EXCL|O_RDWR, 0644);
+            if(fd < 0) throw std::runtime_error("cannot create shared memory " + n);
+            if(::ftruncate(fd, off_t(size)) != 0){
+                ::close(fd); ::shm_unlink(n.c_str());
+                throw std::runtime_error("cannot size shared memory " + n);
+            }
+        }else{
+            fd = ::shm_open(n.c_str(), O_RDONLY, 0);
+            if(fd < 0) throw std::runtime_error("cannot open shared memory " + n);
+            struct stat st;
+            if(::fstat(fd, &st) != 0){ ::close(fd); throw std::runtime_error("cannot stat " + n); }
+            size = size_t(st.st_size);
+            if(size < sizeof(Header)){ ::close(fd); throw std::runtime_error(n + " is not an NBBO segment"); }
+        }
+        void* p = ::mmap(nullptr, size, create ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(p == MAP_FAILED) throw std::runtime_error("cannot mmap shared memory " + n);
+        base_ = p;
+        size_ = size;
+    }
+    ~Segment(){ if(base_) ::munmap(base_, size_); }
+    Segment(const Segment&) = delete;
+    Segment& operator=(const Segment&) = delete;
+
+    void*  data() const { return base_; }
+    size_t size() const { return size_; }
+};
+
+} // namespace shm_detail
+
+/* ---------- records seen by readers ---------- */
+struct TopOfBook {
+    int32_t  bid_ticks{NO_TICK};
+    uint32_t bid_qty{0};
+    int32_t  ask_ticks{NO_TICK};
+    uint32_t ask_qty{0};
+    uint16_t bid_mask{0};
+    uint16_t ask_mask{0};
+    uint64_t updates{0};            /* times the writer changed this row */
+
+    bool same_quote(const TopOfBook& o) const {
+        return bid_ticks==o.bid_ticks && bid_qty==o.bid_qty && bid_mask==o.bid_mask &&
+               ask_ticks==o.ask_ticks && ask_qty==o.ask_qty && ask_mask==o.ask_mask;
+    }
+};
+
+/* one side's new best; layout matches nbbo_update_dtype */
+#pragma pack(push,1)
+struct NbboUpdate {
+    uint64_t seq;                   /* ring position, gap-free per writer */
+    uint32_t instrument;
+    uint8_t  side;                  /* Side                              */
+    int32_t  price_ticks;           /* NO_TICK: side now empty           */
+    uint32_t qty;
+    uint16_t venue_mask;
+};
+#pragma pack(pop)
+static_assert(sizeof(NbboUpdate) == 23, "NbboUpdate must stay packed");
+
+/* current top of book of any book type */
+template<class Book>
+inline TopOfBook top_of(const Book& b){
+    TopOfBook t;
+    if(!b.empty(Side::Bid)){
+        const PriceLevel* pl = b.find(Side::Bid, t.bid_ticks = b.best_idx(Side::Bid));
+        t.bid_qty = pl->agg; t.bid_mask = pl->mask;
+    }
+    if(!b.empty(Side::Ask)){
+        const PriceLevel* pl = b.find(Side::Ask, t.ask_ticks = b.best_idx(Side::Ask));
+        t.ask_qty = pl->agg; t.ask_mask = pl->mask;
+    }
+    return t;
+}
+
+/* ---------- NbboShmWriter ---------- */
+class NbboShmWriter {
+    shm_detail::Segment    seg_;
+    shm_detail::Header*    hdr_;
+    shm_detail::Row*       rows_;
+    shm_detail::Slot*      ring_;
+    uint64_t               ring_mask_;
+    uint64_t               head_{0};
+    std::vector<TopOfBook> last_;           /* what each row holds now */
+
+    void push(uint32_t instrument,Side s,int32_t px,uint32_t qty,uint16_t mask){
+        shm_detail::Slot& sl = ring_[head_ & ring_mask_];
+        sl.stamp.store(2*head_+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        sl.instrument.store(instrument, std::memory_order_relaxed);
+        sl.side_mask.store(uint32_t(s) | uint32_t(mask)<<8, std::memory_order_relaxed);
+        sl.price_ticks.store(px, std::memory_order_relaxed);
+        sl.qty.store(qty, std::memory_order_relaxed);
+        sl.stamp.store(2*head_+2, std::memory_order_release);
+        hdr_->ring_head.store(++head_, std::memory_order_release);
+    }
+
+public:
+    /* instruments: table rows (ids 0..instruments-1); ring_slots rounds up
+       to a power of two, 0 publishes the table only                      */
+    NbboShmWriter(const std::string& name,uint32_t instruments,size_t ring_slots = 0)
+        : seg_(name, shm_detail::segment_size(instruments, shm_detail::ring_slots_for(ring_slots)), true),
+          last_(instruments)
+    {
+        using namespace shm_detail;
+        if(!instruments) throw std::invalid_argument("need at least one instrument row");
+        uint64_t slots = ring_slots_for(ring_slots);
+        auto* base = static_cast<unsigned char*>(seg_.data());
+        hdr_  = new (base) Header{};
+        rows_ = reinterpret_cast<Row*>(base + sizeof(Header));
+        ring_ = reinterpret_cast<Slot*>(base + sizeof(Header) + size_t(instruments)*sizeof(Row));
+        for(uint32_t i=0;i<instruments;++i){
+            Row* r = new (&rows_[i]) Row{};
+            r->bid_ticks.store(NO_TICK, std::memory_order_relaxed);
+            r->ask_ticks.store(NO_TICK, std::memory_order_relaxed);
+        }
+        for(uint64_t i=0;i<slots;++i) new (&ring_[i]) Slot{};
+        ring_mask_        = slots ? slots-1 : 0;
+        hdr_->version     = VERSION;
+        hdr_->instruments = instruments;
+        hdr_->ring_slots  = slots;
+        hdr_->magic.store(MAGIC, std::memory_order_release);
+    }
+
+    static void unlink(const std::string& name){ ::shm_unlink(shm_detail::shm_name(name).c_str()); }
+
+    uint32_t instruments() const { return uint32_t(last_.size()); }
+    bool     has_ring()    const { return hdr_->ring_slots != 0; }
+    uint64_t ring_written() const { return head_; }
+
+    /* write instrument's row (and ring records for the sides that moved)
+       if t differs from what it holds; returns true if anything changed */
+    bool publish(uint32_t instrument,const TopOfBook& t){
+        if(instrument >= last_.size()) throw std::out_of_range("instrument beyond the NBBO table");
+        TopOfBook& was = last_[instrument];
+        if(was.same_quote(t)) return false;
+
+        shm_detail::Row& r = rows_[instrument];
+        uint32_t s = r.seq.load(std::memory_order_relaxed);
+        r.seq.store(s+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        r.bid_ticks.store(t.bid_ticks, std::memory_order_relaxed);
+        r.bid_qty.store(t.bid_qty, std::memory_order_relaxed);
+        r.ask_ticks.store(t.ask_ticks, std::memory_order_relaxed);
+        r.ask_qty.store(t.ask_qty, std::memory_order_relaxed);
+        r.masks.store(uint32_t(t.bid_mask) | uint32_t(t.ask_mask)<<16, std::memory_order_relaxed);
+        r.updates.store(was.updates+1, std::memory_order_relaxed);
+        r.seq.store(s+2, std::memory_order_release);
+
+        if(has_ring()){
+            if(t.bid_ticks!=was.bid_ticks || t.bid_qty!=was.bid_qty || t.bid_mask!=was.bid_mask)
+                push(instrument, Side::Bid, t.bid_ticks, t.bid_qty, t.bid_mask);
+            if(t.ask_ticks!=was.ask_ticks || t.ask_qty!=was.ask_qty || t.ask_mask!=was.ask_mask)
+                push(instrument, Side::Ask, t.ask_ticks, t.ask_qty, t.ask_mask);
+        }
+        uint64_t n = was.updates+1;
+        was = t;
+        was.updates = n;
+        return true;
+    }
+    template<class Book>
+    bool update(uint32_t instrument,const Book& b){ return publish(instrument, top_of(b)); }
+
+    /* every row from mgr: open books as they stand, the rest empty */
+    void publish_all(const BookManager& mgr){
+        for(uint32_t i=0;i<instruments();++i){
+            const OrderBookCore* b = mgr.find(i);
+            publish(i, b ? top_of(*b) : TopOfBook{});
+        }
+    }
+};
+
+/* BookManager::apply that refreshes the shared table after every message.
+   Instruments are all checked first: a batch naming one beyond the table
+   throws before any message reaches a book, the table or out.          */
+template<class Sink>
+void apply_published(BookManager& mgr,const RoutedMsg* msgs,size_t n,Sink& out,NbboShmWriter& w){
+    for(size_t i=0;i<n;++i)
+        if(msgs[i].instrument >= w.instruments())
+            throw std::out_of_range("instrument beyond the NBBO table (message " + std::to_string(i) + ")");
+    for(size_t i=0;i<n;++i){
+        uint32_t inst = msgs[i].instrument;
+        mgr.apply(&msgs[i], 1, out);
+        w.update(inst, *mgr.find(inst));
+    }
+}
+
+/* ---------- NbboShmReader ---------- */
+class NbboShmReader {
+    shm_detail::Segment       seg_;
+    const shm_detail::Header* hdr_;
+    const shm_detail::Row*    rows_;
+    const shm_detail::Slot*   ring_;
+    uint64_t                  cursor_{0};
+    uint64_t                  lost_{0};
+
+public:
+    /* from_start=false skips ring records written before the reader opened */
+    explicit NbboShmReader(const std::string& name,bool from_start = false)
+        : seg_(name, 0, false)
+    {
+        using namespace shm_detail;
+        auto* base = static_cast<const unsigned char*>(seg_.data());
+        hdr_ = reinterpret_cast<const Header*>(base);
+        if(hdr_->magic.load(std::memory_order_acquire) != MAGIC || hdr_->version != VERSION)
+            throw std::runtime_error(name + " is not a ready NBBO segment");
+        if(seg_.size() < segment_size(hdr_->instruments, hdr_->ring_slots))
+            throw std::runtime_error(name + " is truncated");
+        rows_ = reinterpret_cast<const Row*>(base + sizeof(Header));
+        ring_ = reinterpret_cast<const Slot*>(base + sizeof(Header) + size_t(hdr_->instruments)*sizeof(Row));
+        if(!from_start) cursor_ = hdr_->ring_head.load(std::memory_order_acquire);
+    }
+
+    uint32_t instruments() const { return hdr_->instruments; }
+    bool     has_ring()    const { return hdr_->ring_slots != 0; }
+    uint64_t lost()        const { return lost_; }     /* ring records overwritten before read */
+
+    /* consistent copy of instrument's row; false if the id is out of range
+       or the writer stayed mid-update for the whole retry budget          */
+    bool read(uint32_t instrument,TopOfBook& out,unsigned spins = 1u<<16) const {
+        if(instrument >= hdr_->instruments) return false;
+        const shm_detail::Row& r = rows_[instrument];
+        for(unsigned i=0;i<spins;++i){
+            uint32_t s1 = r.seq.load(std::memory_order_acquire);
+            if(s1 & 1){ cpu_relax(); continue; }
+            out.bid_ticks = r.bid_ticks.load(std::memory_order_relaxed);
+            out.bid_qty   = r.bid_qty.load(std::memory_order_relaxed);
+            out.ask_ticks = r.ask_ticks.load(std::memory_order_relaxed);
+            out.ask_qty   = r.ask_qty.load(std::memory_order_relaxed);
+            uint32_t m    = r.masks.load(std::memory_order_relaxed);
+            out.updates   = r.updates.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(r.seq.load(std::memory_order_relaxed) != s1) continue;
+            out.bid_mask = uint16_t(m);
+            out.ask_mask = uint16_t(m>>16);
+            return true;
+        }
+        return false;
+    }
+
+    /* up to max ring records past the cursor into out; records the writer
+       overwrote first are skipped and counted in lost()                   */
+    size_t poll(NbboUpdate* out,size_t max){
+        if(!has_ring()) return 0;
+        const uint64_t slots = hdr_->ring_slots;
+        size_t n = 0;
+        while(n < max){
+            uint64_t head = hdr_->ring_head.load(std::memory_order_acquire);
+            if(cursor_ >= head) break;
+            if(head - cursor_ > slots){ lost_ += head - slots - cursor_; cursor_ = head - slots; }
+            const shm_detail::Slot& sl = ring_[cursor_ & (slots-1)];
+            uint64_t want = 2*cursor_+2;
+            uint64_t s1 = sl.stamp.load(std::memory_order_acquire);
+            NbboUpdate u;
+            u.seq         = cursor_;
+            u.instrument  = sl.instrument.load(std::memory_order_relaxed);
+            uint32_t sm   = sl.side_mask.load(std::memory_order_relaxed);
+            u.price_ticks = sl.price_ticks.load(std::memory_order_relaxed);
+            u.qty         = sl.qty.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t s2 = sl.stamp.load(std::memory_order_relaxed);
+            ++cursor_;
+            if(s1 != want || s2 != want){ ++lost_; continue; }   /* lapped mid-read */
+            u.side       = uint8_t(sm);
+            u.venue_mask = uint16_t(sm>>8);
+            out[n++] = u;
+        }
+        return n;
+    }
+};
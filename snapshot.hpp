@@ -0,0 +1,406 @@
+#pragma once
+/*
+ * Book snapshots: the complete state of one book or a whole BookManager
+ * (window anchors, every level with its per-venue qty, every open order)
+ * in a compact file that is mmapped back and restored in one pass per
+ * section.  A restarted or standby process loads the latest snapshot and
+ * replays the feed from its seq instead of from the open.
+ *
+ * Layout, packed, host byte order:
+ *
+ *   SnapshotHeader                      magic, version, books, seq
+ *   per book:
+ *     SnapshotBook                      instrument, anchors, section counts
+ *     LevelRecord    [levels]
+ *     IntOrderRecord [int_orders]       L3 books: in queue (arrival) order
+ *     StrOrderRecord [str_orders]       each followed by its oid bytes
+ *
+ * An L3 book's int- and string-keyed orders can share a queue, so each
+ * order record carries its rank in the book's arrival order and restore
+ * merges the two sections on it.
+ *
+ * Levels are stored as they stand, not re-derived from the orders, so a
+ * restored book is identical to the saved one.  Watched orders (L3) are
+ * not persisted.
+ *
+ * SnapshotWriter takes periodic snapshots without stopping the book for
+ * disk I/O: the book thread only serializes into whichever of two
+ * buffers the writer thread is not using; the writer thread writes the
+ * newest one through a temp file and rename, so a crash never leaves a
+ * partial snapshot behind.
+ */
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "book_manager.hpp"
+#include "replay.hpp"
+
+/* ---------- file records ---------- */
+#pragma pack(push,1)
+struct SnapshotHeader {
+    char     magic[8];          /* SNAPSHOT_MAGIC                    */
+    uint32_t version;
+    uint32_t books;
+    uint64_t seq;               /* caller's feed position            */
+};
+struct SnapshotBook {
+    uint32_t instrument;
+    uint8_t  anchored[2];       /* [Side]                            */
+    int32_t  origin[2];         /* dense window tick 0, per side     */
+    uint32_t levels;
+    uint32_t int_orders;
+    uint32_t str_orders;
+};
+struct LevelRecord {
+    uint8_t  side;
+    int32_t  price_ticks;
+    uint32_t agg;
+    uint16_t venue_mask;
+    uint32_t venue_qty[NUM_VENUES];
+};
+struct IntOrderRecord {
+    uint64_t oid;
+    int32_t  price_ticks;
+    uint32_t qty;
+    uint8_t  venue;
+    uint8_t  side;
+    uint32_t rank;              /* arrival order (L3), else 0        */
+};
+struct StrOrderRecord {
+    uint32_t len;               /* oid bytes that follow             */
+    int32_t  price_ticks;
+    uint32_t qty;
+    uint8_t  venue;
+    uint8_t  side;
+    uint32_t rank;
+};
+#pragma pack(pop)
+
+inline constexpr char     SNAPSHOT_MAGIC[8] = {'O','B','S','N','A','P','\0','\1'};
+inline constexpr uint32_t SNAPSHOT_VERSION  = 2;
+
+/* ---------- serialization ---------- */
+namespace snapshot_detail {
+template<class T>
+inline void append(std::vector<uint8_t>& buf,const T& v){
+    size_t at = buf.size();
+    buf.resize(at + sizeof(T));
+    std::memcpy(&buf[at], &v, sizeof(T));
+}
+inline void append_bytes(std::vector<uint8_t>& buf,const void* p,size_t n){
+    const auto* b = static_cast<const uint8_t*>(p);
+    buf.insert(buf.end(), b, b+n);
+}
+/* arrival order of an order, or 0 for books without queues */
+template<class Book>
+inline uint64_t arrival(const typename Book::meta_type& m){
+    if constexpr (Book::queues_type::TRACKS_ORDERS) return m.node ? m.node->seq : 0;
+    else return 0;
+}
+template<Side S,class Book>
+inline uint32_t append_levels(std::vector<uint8_t>& buf,const Book& b){
+    uint32_t n = 0;
+    b.template book<S>().for_each_level([&](int idx,const PriceLevel& pl){
+        LevelRecord r;
+        r.side        = uint8_t(S);
+        r.price_ticks = idx;
+        r.agg         = pl.agg;
+        r.venue_mask  = pl.mask;
+        lanes::copy_out(pl.vqty, r.venue_qty);
+        append(buf, r);
+        ++n;
+    });
+    return n;
+}
+inline Meta meta_of(int32_t idx,uint32_t qty,uint8_t venue,uint8_t side){
+    if(venue >= NUM_VENUES || side > uint8_t(Side::Ask))
+        throw std::runtime_error("corrupt snapshot: bad order record");
+    return Meta{idx, qty, venue, Side(side)};
+}
+} // namespace snapshot_detail
+
+/* append one book's section to buf */
+template<class Book>
+void serialize_book(std::vector<uint8_t>& buf,uint32_t instrument,const Book& b){
+    using namespace snapshot_detail;
+    size_t head = buf.size();
+    SnapshotBook sb{};
+    sb.instrument = instrument;
+    const auto& bid = b.template book<Side::Bid>();
+    const auto& ask = b.template book<Side::Ask>();
+    sb.anchored[size_t(Side::Bid)] = bid.anchored();
+    sb.anchored[size_t(Side::Ask)] = ask.anchored();
+    sb.origin[size_t(Side::Bid)]   = bid.origin();
+    sb.origin[size_t(Side::Ask)]   = ask.origin();
+    append(buf, sb);
+
+    sb.levels  = append_levels<Side::Bid>(buf, b);
+    sb.levels += append_levels<Side::Ask>(buf, b);
+
+    using M = typename Book::meta_type;
+    std::vector<std::pair<uint64_t,IntOrderRecord>>           ints;
+    std::vector<std::pair<uint64_t,const std::string*>>       strs;
+    std::vector<M>                                            str_meta;
+    b.for_each_order([&](const auto& oid,const M& m){
+        if constexpr (std::is_same<std::decay_t<decltype(oid)>,uint64_t>::value)
+            ints.push_back({arrival<Book>(m),
+                            IntOrderRecord{oid, m.idx, m.qty, m.vid, uint8_t(m.side), 0}});
+        else{
+            strs.push_back({arrival<Book>(m), &oid});
+            str_meta.push_back(m);
+        }
+    });
+    std::vector<size_t> order(strs.size());
+    for(size_t i=0;i<order.size();++i) order[i] = i;
+    std::vector<uint32_t> str_rank(strs.size(), 0);
+    if constexpr (Book::queues_type::TRACKS_ORDERS){
+        auto by_arrival = [](const auto& a,const auto& c){ return a.first < c.first; };
+        std::sort(ints.begin(), ints.end(), by_arrival);
+        std::sort(order.begin(), order.end(),
+                  [&](size_t a,size_t c){ return strs[a].first < strs[c].first; });
+        uint32_t rank = 0;                                  /* merge the two arrival orders */
+        for(size_t i=0, j=0; i<ints.size() || j<order.size(); ){
+            if(j==order.size() || (i<ints.size() && ints[i].first < strs[order[j]].first))
+                ints[i++].second.rank = rank++;
+            else
+                str_rank[order[j++]] = rank++;
+        }
+    }
+    for(const auto& o : ints) append(buf, o.second);
+    for(size_t i : order){
+        const std::string& oid = *strs[i].second;
+        const M& m = str_meta[i];
+        append(buf, StrOrderRecord{uint32_t(oid.size()), m.idx, m.qty, m.vid, uint8_t(m.side), str_rank[i]});
+        append_bytes(buf, oid.data(), oid.size());
+    }
+
+    sb.int_orders = uint32_t(ints.size());
+    sb.str_orders = uint32_t(strs.size());
+    std::memcpy(&buf[head], &sb, sizeof sb);
+}
+
+inline void begin_snapshot(std::vector<uint8_t>& buf,uint32_t books,uint64_t seq){
+    SnapshotHeader h{};
+    std::memcpy(h.magic, SNAPSHOT_MAGIC, sizeof h.magic);
+    h.version = SNAPSHOT_VERSION;
+    h.books   = books;
+    h.seq     = seq;
+    buf.clear();
+    snapshot_detail::append(buf, h);
+}
+
+/* whole snapshot of one book (instrument 0) or a manager, into buf */
+template<class Book>
+void serialize(std::vector<uint8_t>& buf,const Book& b,uint64_t seq){
+    begin_snapshot(buf, 1, seq);
+    serialize_book(buf, 0, b);
+}
+inline void serialize(std::vector<uint8_t>& buf,const BookManager& mgr,uint64_t seq){
+    begin_snapshot(buf, uint32_t(mgr.size()), seq);
+    mgr.for_each([&](uint32_t instrument,const OrderBookCore& b){ serialize_book(buf, instrument, b); });
+}
+
+/* write buf to path via path.tmp + fsync + rename */
+inline void write_snapshot_file(const std::string& path,const std::vector<uint8_t>& buf){
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if(fd < 0) throw std::runtime_error("cannot create " + tmp);
+    size_t off = 0;
+    while(off < buf.size()){
+        ssize_t n = ::write(fd, buf.data()+off, buf.size()-off);
+        if(n <= 0){ ::close(fd); throw std::runtime_error("short write on " + tmp); }
+        off += size_t(n);
+    }
+    if(::fsync(fd) != 0 || ::close(fd) != 0) throw std::runtime_error("cannot sync " + tmp);
+    if(std::rename(tmp.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("cannot rename " + tmp + " to " + path);
+}
+
+/* ---------- restore ---------- */
+/* walks a snapshot in memory (e.g. a MappedFile) one book at a time */
+class SnapshotReader {
+    const uint8_t* p_;
+    const uint8_t* end_;
+    SnapshotHeader h_;
+    uint32_t       left_;
+
+    const uint8_t* take(size_t n){
+        if(size_t(end_-p_) < n) throw std::runtime_error("corrupt snapshot: truncated");
+        const uint8_t* at = p_;
+        p_ += n;
+        return at;
+    }
+    template<class T>
+    T read(){ T v; std::memcpy(&v, take(sizeof v), sizeof v); return v; }
+
+public:
+    SnapshotReader(const uint8_t* data,size_t len) : p_(data), end_(data+len) {
+        h_ = read<SnapshotHeader>();
+        if(std::memcmp(h_.magic, SNAPSHOT_MAGIC, sizeof h_.magic) != 0)
+            throw std::runtime_error("not a book snapshot");
+        if(h_.version != SNAPSHOT_VERSION)
+            throw std::runtime_error("unsupported snapshot version " + std::to_string(h_.version));
+        left_ = h_.books;
+    }
+
+    uint64_t seq()   const { return h_.seq; }
+    uint32_t books() const { return h_.books; }
+    bool     done()  const { return left_ == 0; }
+
+    /* instrument id of the next book without consuming it */
+    uint32_t peek_instrument() const {
+        SnapshotBook sb;
+        if(size_t(end_-p_) < sizeof sb) throw std::runtime_error("corrupt snapshot: truncated");
+        std::memcpy(&sb, p_, sizeof sb);
+        return sb.instrument;
+    }
+
+    /* reset b and restore the next book into it; returns its instrument */
+    template<class Book>
+    uint32_t next(Book& b){
+        using namespace snapshot_detail;
+        if(!left_) throw std::runtime_error("no more books in snapshot");
+        --left_;
+        SnapshotBook sb = read<SnapshotBook>();
+        b.reset();
+        for(Side s : {Side::Bid, Side::Ask})
+            if(sb.anchored[size_t(s)]) b.restore_anchor(s, sb.origin[size_t(s)]);
+        for(uint32_t i=0;i<sb.levels;++i){
+            LevelRecord r = read<LevelRecord>();
+            PriceLevel pl;
+            lanes::copy_in(r.venue_qty, pl.vqty);
+            pl.recompute();
+            if(r.side > uint8_t(Side::Ask) || pl.agg != r.agg || pl.mask != r.venue_mask)
+                throw std::runtime_error("corrupt snapshot: bad level record");
+            b.restore_level(Side(r.side), r.price_ticks, pl);
+        }
+        /* both sections are in arrival order; restore them merged on rank
+           so queues shared by int and string oids keep their order        */
+        const uint8_t* ints = take(size_t(sb.int_orders) * sizeof(IntOrderRecord));
+        auto int_at = [ints](uint32_t k){
+            IntOrderRecord r;
+            std::memcpy(&r, ints + size_t(k)*sizeof r, sizeof r);
+            return r;
+        };
+        uint32_t i = 0, j = 0;
+        StrOrderRecord sr{};
+        if(sb.str_orders) sr = read<StrOrderRecord>();
+        std::string oid;
+        while(i < sb.int_orders || j < sb.str_orders){
+            if(i < sb.int_orders){
+                IntOrderRecord ir = int_at(i);
+                if(j == sb.str_orders || ir.rank <= sr.rank){
+                    b.restore_order(uint64_t(ir.oid), meta_of(ir.price_ticks, ir.qty, ir.venue, ir.side));
+                    ++i;
+                    continue;
+                }
+            }
+            oid.assign(reinterpret_cast<const char*>(take(sr.len)), sr.len);
+            b.restore_order(oid, meta_of(sr.price_ticks, sr.qty, sr.venue, sr.side));
+            if(++j < sb.str_orders) sr = read<StrOrderRecord>();
+        }
+        b.restore_done();
+        return sb.instrument;
+    }
+};
+
+/* ---------- file helpers ---------- */
+template<class Book>
+void save_snapshot(const std::string& path,const Book& b,uint64_t seq = 0){
+    std::vector<uint8_t> buf;
+    serialize(buf, b, seq);
+    write_snapshot_file(path, buf);
+}
+
+/* restore a single-book snapshot (its first book) into b; returns seq */
+template<class Book>
+uint64_t load_snapshot(const std::string& path,Book& b){
+    MappedFile file(path);
+    SnapshotReader rd(file.data(), file.size());
+    if(rd.done()) b.reset();
+    else          rd.next(b);
+    return rd.seq();
+}
+/* replace every open book of mgr with the snapshot's books; returns seq */
+inline uint64_t load_snapshot(const std::string& path,BookManager& mgr){
+    MappedFile file(path);
+    SnapshotReader rd(file.data(), file.size());
+    std::vector<uint32_t> open;
+    mgr.for_each([&](uint32_t instrument,const OrderBookCore&){ open.push_back(instrument); });
+    for(uint32_t i : open) mgr.close(i);
+    while(!rd.done()) rd.next(mgr.open(rd.peek_instrument()));
+    return rd.seq();
+}
+
+/* ---------- SnapshotWriter ---------- */
+class SnapshotWriter {
+    std::string             path_;
+    std::vector<uint8_t>    buf_[2];
+    int                     writing_{-1};       /* buffer on the writer thread */
+    int                     pending_{-1};       /* newest buffer not yet taken */
+    bool                    stop_{false};
+    uint64_t                written_{0};
+    std::string             error_;
+    std::mutex              mu_;
+    std::condition_variable cv_;
+    std::thread             thread_;
+
+    void run(){
+        std::unique_lock<std::mutex> lk(mu_);
+        for(;;){
+            cv_.wait(lk, [this]{ return stop_ || pending_ >= 0; });
+            if(pending_ < 0) return;                    /* stopped, nothing left */
+            writing_ = pending_;
+            pending_ = -1;
+            lk.unlock();
+            std::string err;
+            try{ write_snapshot_file(path_, buf_[writing_]); }
+            catch(const std::exception& e){ err = e.what(); }
+            lk.lock();
+            writing_ = -1;
+            if(err.empty()) ++written_; else error_ = err;
+            cv_.notify_all();
+        }
+    }
+
+public:
+    explicit SnapshotWriter(std::string path) : path_(std::move(path)),
+                                                thread_([this]{ run(); }) {}
+    ~SnapshotWriter(){
+        { std::lock_guard<std::mutex> lk(mu_); stop_ = true; }
+        cv_.notify_all();
+        thread_.join();                                 /* finishes a pending write */
+    }
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    /* serialize on the calling (book) thread and queue it for writing; a
+       snapshot still queued is superseded, one being written is left be */
+    template<class Source>
+    void offer(const Source& src,uint64_t seq){
+        int i;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            i = writing_==0 ? 1 : 0;
+            if(pending_ == i) pending_ = -1;
+        }
+        serialize(buf_[i], src, seq);
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            pending_ = i;
+        }
+        cv_.notify_all();
+    }
+
+    /* block until everything offered so far is on disk */
+    void flush(){
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [this]{ return pending_ < 0 && writing_ < 0; });
+    }
+
+    uint64_t written(){ std::lock_guard<std::mutex> lk(mu_); return written_; }
+    /* last write failure, empty if none */
+    std::string error(){ std::lock_guard<std::mutex> lk(mu_); return error_; }
+};
@@ -0,0 +1,153 @@
+#pragma once
+/*
+ * Lock-free single-producer / single-consumer ring of trivially copyable
+ * records.  Capacity is a power of two; head and tail live on their own
+ * cache lines, and each side caches the other's index so the common case
+ * touches no shared line at all.
+ */
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+constexpr size_t CACHE_LINE = 64;
+
+inline void cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/* pin a worker to one core (no-op where affinity is unsupported) */
+inline void pin_thread(std::thread& t,int cpu){
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu,&set);
+    pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#else
+    (void)t; (void)cpu;
+#endif
+}
+
+template<class T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable<T>::value, "ring holds plain records");
+
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0};   /* written by producer */
+    size_t head_cache_{0};                              /* producer's view     */
+    alignas(CACHE_LINE) std::atomic<size_t> head_{0};   /* written by consumer */
+    size_t tail_cache_{0};                              /* consumer's view     */
+    alignas(CACHE_LINE) size_t mask_;
+    std::unique_ptr<T[]> buf_;
+
+public:
+    explicit SpscRing(size_t capacity)
+        : mask_(capacity-1), buf_(new T[capacity]) {
+        if(capacity<2 || (capacity & mask_))
+            throw std::invalid_argument("SpscRing capacity must be a power of two");
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return mask_+1; }
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size()==0; }
+
+    /* ---------- producer ---------- */
+    bool try_push(const T& item){
+        size_t t = tail_.load(std::memory_order_relaxed);
+        if(t - head_cache_ > mask_){
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if(t - head_cache_ > mask_) return false;
+        }
+        buf_[t & mask_] = item;
+        tail_.store(t+1, std::memory_order_release);
+        return true;
+    }
+    /* free slots right now (refreshes the cached head) */
+    size_t room(){
+        head_cache_ = head_.load(std::memory_order_acquire);
+        return capacity() - (tail_.load(std::memory_order_relaxed) - head_cache_);
+    }
+    /* push up to n items with one release; returns how many were pushed */
+    size_t push_batch(const T* items,size_t n){
+        size_t t    = tail_.load(std::memory_order_relaxed);
+        size_t room = capacity() - (t - head_cache_);
+        if(room < n){
+            head_cache_ = head_.load(std::memory_order_acquire);
+            room = capacity() - (t - head_cache_);
+        }
+        if(n > room) n = room;
+        for(size_t i=0;i<n;++i) buf_[(t+i) & mask_] = items[i];
+        tail_.store(t+n, std::memory_order_release);
+        return n;
+    }
+
+    /* zero-copy publish: write up to the returned count of slots at ptr,
+       then publish(n).  The span stops at the wrap point, so a second
+       claim may return more room.                                       */
+    size_t claim(T*& ptr){
+        size_t t    = tail_.load(std::memory_order_relaxed);
+        size_t room = capacity() - (t - head_cache_);
+        if(!room){
+            head_cache_ = head_.load(std::memory_order_acquire);
+            room = capacity() - (t - head_cache_);
+        }
+        size_t to_wrap = capacity() - (t & mask_);
+        ptr = &buf_[t & mask_];
+        return room < to_wrap ? room : to_wrap;
+    }
+    void publish(size_t n){
+        tail_.store(tail_.load(std::memory_order_relaxed)+n, std::memory_order_release);
+    }
+
+    /* ---------- consumer ---------- */
+    bool try_pop(T& out){
+        size_t h = head_.load(std::memory_order_relaxed);
+        if(h == tail_cache_){
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if(h == tail_cache_) return false;
+        }
+        out = buf_[h & mask_];
+        head_.store(h+1, std::memory_order_release);
+        return true;
+    }
+    /* pop up to max items with one release; returns how many were popped */
+    size_t pop_batch(T* out,size_t max){
+        size_t h = head_.load(std::memory_order_relaxed);
+        size_t avail = tail_cache_ - h;
+        if(avail < max){
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            avail = tail_cache_ - h;
+        }
+        if(max > avail) max = avail;
+        for(size_t i=0;i<max;++i) out[i] = buf_[(h+i) & mask_];
+        head_.store(h+max, std::memory_order_release);
+        return max;
+    }
+    /* zero-copy consume: read the returned count of records at ptr, then
+       release(n).  Like claim(), the span stops at the wrap point.      */
+    size_t peek(const T*& ptr){
+        size_t h = head_.load(std::memory_order_relaxed);
+        if(h == tail_cache_) tail_cache_ = tail_.load(std::memory_order_acquire);
+        size_t avail   = tail_cache_ - h;
+        size_t to_wrap = capacity() - (h & mask_);
+        ptr = &buf_[h & mask_];
+        return avail < to_wrap ? avail : to_wrap;
+    }
+    void release(size_t n){
+        head_.store(head_.load(std::memory_order_relaxed)+n, std::memory_order_release);
+    }
+};
@@ -0,0 +1,113 @@
+#pragma once
+/*
+ * Minimal harness for the native test executables (orderbook_core_test,
+ * pipeline_test): TEST(name) registers a case, CHECK(cond) reports a
+ * failure and carries on, and run_tests() returns the process exit code.
+ * An exception escaping a case fails it.
+ *
+ * Also the shared fixtures: a self-consistent random message stream and
+ * field-by-field BookEvent comparison.
+ */
+#include <cstdio>
+#include <exception>
+#include <random>
+#include <vector>
+#include "orderbook_core.hpp"
+
+namespace test {
+
+struct Case { const char* name; void (*fn)(); };
+
+inline std::vector<Case>& cases(){ static std::vector<Case> c; return c; }
+inline int&         failures(){ static int n = 0; return n; }
+inline const char*& current() { static const char* name = ""; return name; }
+
+struct Register { Register(const char* name,void (*fn)()){ cases().push_back({name, fn}); } };
+
+inline void report(const char* file,int line,const char* what){
+    ++failures();
+    std::fprintf(stderr, "%s:%d: %s: %s\n", file, line, current(), what);
+}
+
+inline int run_tests(){
+    for(const Case& c : cases()){
+        current() = c.name;
+        int before = failures();
+        try{ c.fn(); }
+        catch(const std::exception& e){ report(__FILE__, __LINE__, e.what()); }
+        std::printf("%-40s %s\n", c.name, failures()==before ? "ok" : "FAILED");
+    }
+    if(failures()){ std::printf("%d check(s) failed\n", failures()); return 1; }
+    std::printf("All %zu tests passed\n", cases().size());
+    return 0;
+}
+
+/* n messages starting from an empty book: adds around 100000 on venues
+   0..13, and cancels / replaces / executes of live orders only         */
+inline std::vector<MsgRecord> random_stream(size_t n,uint32_t seed = 1,int spread = 40){
+    struct Live { uint64_t oid; uint32_t qty; };
+    std::mt19937_64 rng(seed);
+    std::vector<MsgRecord> out;
+    std::vector<Live> live;
+    uint64_t next = 1;
+    auto quote = [&](MsgRecord& r){
+        bool bid = rng() & 1;
+        int  off = int(rng() % unsigned(spread));
+        r.side        = uint8_t(bid ? Side::Bid : Side::Ask);
+        r.price_ticks = bid ? 99999-off : 100001+off;
+        r.venue       = uint8_t(rng() % NUM_VENUES);
+        r.qty         = 1 + uint32_t(rng() % 50);
+    };
+    while(out.size() < n){
+        MsgRecord r{};
+        unsigned kind = unsigned(rng() % 10);              /* 4 add, 2 cancel, 3 replace, 1 execute */
+        if(live.empty() || (kind >= 4 && live.size() < size_t(4*spread) && rng()%2)) kind = 0;
+        if(kind < 4){
+            r.msg_type = MSG_ADD;
+            r.oid = next++;
+            quote(r);
+            live.push_back({r.oid, r.qty});
+        }else{
+            size_t k = rng() % live.size();
+            Live& o = live[k];
+            if(kind < 6){
+                r.msg_type = MSG_CANCEL;
+                r.oid = o.oid;
+                o = live.back(); live.pop_back();
+            }else if(kind < 9){
+                r.msg_type = MSG_REPLACE;
+                r.old_oid = o.oid;
+                r.oid = next++;
+                quote(r);
+                o = {r.oid, r.qty};
+            }else{
+                r.msg_type = MSG_EXECUTE;
+                r.oid = o.oid;
+                r.qty = 1 + uint32_t(rng() % o.qty);
+                if((o.qty -= r.qty) == 0){ o = live.back(); live.pop_back(); }
+            }
+        }
+        out.push_back(r);
+    }
+    return out;
+}
+
+inline bool same_event(const BookEvent& a,const BookEvent& b){
+    return a.type==b.type && a.idx==b.idx && a.agg==b.agg && a.vmask==b.vmask && a.vqty==b.vqty
+        && (a.type!=EV_NBBO || (a.old_idx==b.old_idx && a.old_agg==b.old_agg));
+}
+inline bool same_events(const std::vector<BookEvent>& a,const std::vector<BookEvent>& b){
+    if(a.size() != b.size()) return false;
+    for(size_t i=0;i<a.size();++i) if(!same_event(a[i], b[i])) return false;
+    return true;
+}
+
+} // namespace test
+
+#define TEST(name) \
+    static void name(); \
+    static test::Register name##_registered(#name, name); \
+    static void name()
+
+#define CHECK(cond) \
+    do{ if(!(cond)) test::report(__FILE__, __LINE__, "CHECK(" #cond ") failed"); }while(0)